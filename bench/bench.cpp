@@ -0,0 +1,368 @@
+/**
+ * @file bench.cpp runs the standard scenarios of the particle world
+ *
+ * @brief Each scenario is run with a growing number of particles for a
+ * fixed number of frames after a warm up, and the time of each stage of
+ * RunPhysics is reported in nanoseconds per particle per frame. The
+ * scenes are built from a fixed seed, so the runs are reproducible.
+ *
+ * Usage: physics_bench [scenario|all] [max particles] [frames]
+ */
+#include <Gorgon/Physics/pworld.h>
+#include <Gorgon/Physics/pcollide.h>
+#include <Gorgon/Physics/plinks.h>
+#include <Gorgon/Physics/pfgen.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace Gorgon::Physics;
+using Gorgon::Geometry::Point3D;
+
+namespace
+{
+    const double FrameTime = 1.0 / 60;
+    const unsigned WarmUpFrames = 10;
+    const unsigned Seed = 1234;
+    const Point3D Gravity(0, -9.81f, 0);
+
+    /**
+     * Ground contacts with a way to add the particles to collide
+     */
+    class Ground : public GroundContacts
+    {
+    public:
+        void Add(Particle &particle){
+            particles.Add(particle);
+        }
+    };
+
+    /**
+     * A scenario builds its scene into the given world and keeps
+     * the generators it creates alive for the run.
+     */
+    class Scenario
+    {
+    public:
+        virtual ~Scenario(){ }
+
+        virtual const char *GetName() const = 0;
+
+        virtual std::unique_ptr<ParticleWorld> CreateWorld(){
+            return std::unique_ptr<ParticleWorld>(new ParticleWorld(1024));
+        }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &random) = 0;
+    };
+
+    /**
+     * Particles falling from random heights onto the ground
+     */
+    class Rain : public Scenario
+    {
+    public:
+        virtual const char *GetName() const{ return "rain"; }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &random){
+            std::uniform_real_distribution<float> x(-50, 50), y(0, 20);
+
+            for(unsigned i = 0; i < count; i++)
+            {
+                Particle &p = world.AddParticle();
+                p.Teleport(Point3D(x(random), y(random), 0));
+                p.SetAcceleration(Gravity);
+                p.SetDamping(0.99);
+                ground.Add(p);
+            }
+
+            world.GetContactGens().Add(ground);
+        }
+
+    private:
+        Ground ground;
+    };
+
+    /**
+     * A horizontal chain of rods hanging from its first particle
+     */
+    class Chain : public Scenario
+    {
+    public:
+        virtual const char *GetName() const{ return "chain"; }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &){
+            const double length = 0.1;
+
+            Particle *last = nullptr;
+            for(unsigned i = 0; i < count; i++)
+            {
+                Particle &p = world.AddParticle();
+                p.Teleport(Point3D(float(i * length), 10, 0));
+                p.SetDamping(0.99);
+
+                if(i == 0)
+                    p.SetInverseMass(0);
+                else
+                    p.SetAcceleration(Gravity);
+
+                if(last)
+                {
+                    rods.emplace_back(new RodLink());
+                    RodLink &rod = *rods.back();
+                    rod.particle[0] = last;
+                    rod.particle[1] = &p;
+                    rod.length = length;
+                    world.GetContactGens().Add(rod);
+                }
+                last = &p;
+            }
+        }
+
+    private:
+        std::vector<std::unique_ptr<RodLink>> rods;
+    };
+
+    /**
+     * A square cloth of springs pinned at its top row
+     */
+    class Cloth : public Scenario
+    {
+    public:
+        virtual const char *GetName() const{ return "cloth"; }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &){
+            const double spacing = 0.1, stiffness = 500;
+            unsigned side = (unsigned)std::ceil(std::sqrt((double)count));
+
+            std::vector<Particle*> grid;
+            for(unsigned i = 0; i < count; i++)
+            {
+                unsigned row = i / side, column = i % side;
+
+                Particle &p = world.AddParticle();
+                p.Teleport(Point3D(float(column * spacing), 10, float(row * spacing)));
+                p.SetDamping(0.9);
+
+                if(row == 0)
+                    p.SetInverseMass(0);
+                else
+                    p.SetAcceleration(Gravity);
+
+                if(column > 0)
+                    connect(world, *grid[i - 1], p, spacing, stiffness);
+                if(row > 0)
+                    connect(world, *grid[i - side], p, spacing, stiffness);
+
+                grid.push_back(&p);
+            }
+        }
+
+    private:
+        void connect(ParticleWorld &world, Particle &first, Particle &second, double rest, double stiffness){
+            springs.emplace_back(new SpringGenerator(second, stiffness, rest));
+            world.GetForceRegistry().Add(&first, springs.back().get());
+
+            springs.emplace_back(new SpringGenerator(first, stiffness, rest));
+            world.GetForceRegistry().Add(&second, springs.back().get());
+        }
+
+        std::vector<std::unique_ptr<SpringGenerator>> springs;
+    };
+
+    /**
+     * The same cloth with its springs in a spring network
+     */
+    class Net : public Scenario
+    {
+    public:
+        Net(double stiffness = 500) : stiffness(stiffness){ }
+
+        virtual const char *GetName() const{ return "net"; }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &){
+            const double spacing = 0.1;
+            unsigned side = (unsigned)std::ceil(std::sqrt((double)count));
+
+            springs.reset(new SpringNetwork(world.GetStore()));
+            springs->Reserve(2 * count);
+
+            std::vector<Particle*> grid;
+            for(unsigned i = 0; i < count; i++)
+            {
+                unsigned row = i / side, column = i % side;
+
+                Particle &p = world.AddParticle();
+                p.Teleport(Point3D(float(column * spacing), 10, float(row * spacing)));
+                p.SetDamping(0.9);
+
+                if(row == 0)
+                    p.SetInverseMass(0);
+                else
+                    p.SetAcceleration(Gravity);
+
+                if(column > 0)
+                    springs->Add(*grid[i - 1], p, stiffness, spacing);
+                if(row > 0)
+                    springs->Add(*grid[i - side], p, stiffness, spacing);
+
+                grid.push_back(&p);
+            }
+
+            world.GetForceRegistry().Add(springs.get());
+        }
+
+    protected:
+        double stiffness;
+        std::unique_ptr<SpringNetwork> springs;
+    };
+
+    /**
+     * A cloth of springs a hundred times stiffer, integrated with
+     * the implicit integrator. The explicit integrators diverge
+     * with these springs at this time step.
+     */
+    class Stiff : public Net
+    {
+    public:
+        Stiff() : Net(50000){ }
+
+        virtual const char *GetName() const{ return "stiff"; }
+
+        virtual std::unique_ptr<ParticleWorld> CreateWorld(){
+            world = new ImplicitParticleWorld(1024);
+            return std::unique_ptr<ParticleWorld>(world);
+        }
+
+        virtual void Setup(ParticleWorld &, unsigned count, std::mt19937 &random){
+            Net::Setup(*world, count, random);
+            world->GetPolicy().Add(*springs);
+        }
+
+    private:
+        ImplicitParticleWorld *world = nullptr;
+    };
+
+    /**
+     * Overlapping particles packed into a pile on the ground,
+     * every particle touches several others
+     */
+    class Pile : public Scenario
+    {
+    public:
+        virtual const char *GetName() const{ return "pile"; }
+
+        virtual void Setup(ParticleWorld &world, unsigned count, std::mt19937 &random){
+            const double radius = 0.05, spacing = 0.08;
+            unsigned side = (unsigned)std::ceil(std::sqrt((double)count));
+            std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+
+            collisions.reset(new ParticleCollisions(world.GetStore()));
+
+            for(unsigned i = 0; i < count; i++)
+            {
+                float x = float((i % side) * spacing) + jitter(random);
+                float y = float((i / side) * spacing) + jitter(random);
+
+                Particle &p = world.AddParticle();
+                p.Teleport(Point3D(x, y, 0));
+                p.SetRadius(radius);
+                p.SetAcceleration(Gravity);
+                p.SetDamping(0.99);
+                ground.Add(p);
+            }
+
+            world.GetContactGens().Add(ground);
+            world.GetContactGens().Add(*collisions);
+        }
+
+    private:
+        Ground ground;
+        std::unique_ptr<ParticleCollisions> collisions;
+    };
+
+    std::unique_ptr<Scenario> create(const char *name)
+    {
+        if(!strcmp(name, "rain"))  return std::unique_ptr<Scenario>(new Rain());
+        if(!strcmp(name, "chain")) return std::unique_ptr<Scenario>(new Chain());
+        if(!strcmp(name, "cloth")) return std::unique_ptr<Scenario>(new Cloth());
+        if(!strcmp(name, "net"))   return std::unique_ptr<Scenario>(new Net());
+        if(!strcmp(name, "stiff")) return std::unique_ptr<Scenario>(new Stiff());
+        if(!strcmp(name, "pile"))  return std::unique_ptr<Scenario>(new Pile());
+        return nullptr;
+    }
+
+    void run(const char *name, unsigned count, unsigned frames)
+    {
+        std::unique_ptr<Scenario> scenario = create(name);
+        std::mt19937 random(Seed);
+
+        std::unique_ptr<ParticleWorld> created = scenario->CreateWorld();
+        ParticleWorld &world = *created;
+        world.GetResolver().SetMode(ParticleContactResolver::Mode::Heap);
+        scenario->Setup(world, count, random);
+
+        for(unsigned i = 0; i < WarmUpFrames; i++)
+            world.RunPhysics(FrameTime);
+
+        ParticleWorldStats total;
+        for(unsigned i = 0; i < frames; i++)
+        {
+            world.RunPhysics(FrameTime);
+
+            const ParticleWorldStats &stats = world.GetStats();
+            total.forceTime += stats.forceTime;
+            total.integrateTime += stats.integrateTime;
+            total.generateTime += stats.generateTime;
+            total.resolveTime += stats.resolveTime;
+            total.sleepTime += stats.sleepTime;
+            total.totalTime += stats.totalTime;
+            total.contacts += stats.contacts;
+            total.iterationsUsed += stats.iterationsUsed;
+        }
+
+        double scale = 1.0 / ((double)count * frames);
+        printf("%-6s %8u %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %10u %10u\n",
+               name, count,
+               total.forceTime * scale, total.integrateTime * scale,
+               total.generateTime * scale, total.resolveTime * scale,
+               total.sleepTime * scale, total.totalTime * scale,
+               total.contacts / frames, total.iterationsUsed / frames);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *names[] = {"rain", "chain", "cloth", "net", "stiff", "pile"};
+
+    const char *only = argc > 1 ? argv[1] : "all";
+    unsigned maxCount = argc > 2 ? (unsigned)atoi(argv[2]) : 10000;
+    unsigned frames = argc > 3 ? (unsigned)atoi(argv[3]) : 100;
+
+    if(strcmp(only, "all") && !create(only))
+    {
+        fprintf(stderr, "unknown scenario %s, use rain, chain, cloth, net, stiff, pile or all\n", only);
+        return 1;
+    }
+    if(frames == 0) frames = 1;
+
+    printf("ns per particle per frame, %u frames after %u warm up frames, %s reals, %uD\n",
+           frames, WarmUpFrames, sizeof(real) == sizeof(float) ? "float" : "double", ParticleStore::Axes);
+    printf("%-6s %8s %9s %9s %9s %9s %9s %9s %10s %10s\n",
+           "scene", "N", "force", "integrate", "generate", "resolve", "sleep", "total",
+           "contacts", "iterations");
+
+    for(const char *name : names)
+    {
+        if(strcmp(only, "all") && strcmp(only, name)) continue;
+
+        for(unsigned count = 100; count <= maxCount; count *= 10)
+            run(name, count, frames);
+    }
+
+    return 0;
+}
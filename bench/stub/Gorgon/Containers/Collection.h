@@ -0,0 +1,64 @@
+/**
+ * @file Collection.h is a minimal stand-in for the Gorgon collection,
+ * a list of pointers that iterates over references. It lets the
+ * benchmark build without the full engine.
+ */
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Containers
+    {
+        template<class T_>
+        class Collection
+        {
+        public:
+            class Iterator
+            {
+            public:
+                Iterator(typename std::vector<T_*>::const_iterator it) : it(it){ }
+
+                T_ &operator*() const{ return **it; }
+                T_ *operator->() const{ return *it; }
+                Iterator &operator++(){ ++it; return *this; }
+                bool operator==(const Iterator &o) const{ return it == o.it; }
+                bool operator!=(const Iterator &o) const{ return it != o.it; }
+
+            private:
+                typename std::vector<T_*>::const_iterator it;
+            };
+
+            Collection(){ }
+            Collection(const Collection &) = delete;
+            Collection(Collection &&) = default;
+            Collection &operator=(Collection &&) = default;
+
+            void Add(T_ *item){ list.push_back(item); }
+            void Add(T_ &item){ list.push_back(&item); }
+
+            void Remove(const T_ *item){ list.erase(std::remove(list.begin(), list.end(), item), list.end()); }
+            void Remove(const T_ &item){ Remove(&item); }
+
+            void Delete(const T_ *item){ Remove(item); delete item; }
+
+            void Clear(){ list.clear(); }
+            void Destroy(){
+                for(T_ *item : list) delete item;
+                list.clear();
+            }
+
+            long GetCount() const{ return (long)list.size(); }
+
+            T_ &operator[](long index) const{ return *list[index]; }
+
+            Iterator begin() const{ return Iterator(list.begin()); }
+            Iterator end() const{ return Iterator(list.end()); }
+
+        private:
+            std::vector<T_*> list;
+        };
+    }
+}
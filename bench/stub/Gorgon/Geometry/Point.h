@@ -0,0 +1,7 @@
+/**
+ * @file Point.h is a minimal stand-in for the Gorgon geometry header,
+ * the physics module only uses the 3D point from it.
+ */
+#pragma once
+
+#include "Point3D.h"
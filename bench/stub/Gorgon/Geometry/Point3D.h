@@ -0,0 +1,61 @@
+/**
+ * @file Point3D.h is a minimal stand-in for the Gorgon 3D point, with
+ * only what the physics module uses. It lets the benchmark build
+ * without the full engine.
+ */
+#pragma once
+
+#include <cmath>
+
+namespace Gorgon
+{
+    namespace Geometry
+    {
+        template<class T_>
+        class basic_Point3D
+        {
+        public:
+            T_ X = 0, Y = 0, Z = 0;
+
+            basic_Point3D(){ }
+            basic_Point3D(T_ x, T_ y, T_ z) : X(x), Y(y), Z(z){ }
+
+            basic_Point3D operator+(const basic_Point3D &o) const{ return {X + o.X, Y + o.Y, Z + o.Z}; }
+            basic_Point3D operator-(const basic_Point3D &o) const{ return {X - o.X, Y - o.Y, Z - o.Z}; }
+            basic_Point3D operator-() const{ return {-X, -Y, -Z}; }
+
+            template<class O_>
+            basic_Point3D operator*(O_ s) const{ return {T_(X * s), T_(Y * s), T_(Z * s)}; }
+
+            /// Dot product
+            T_ operator*(const basic_Point3D &o) const{ return X * o.X + Y * o.Y + Z * o.Z; }
+
+            template<class O_>
+            basic_Point3D operator/(O_ s) const{ return {T_(X / s), T_(Y / s), T_(Z / s)}; }
+
+            basic_Point3D &operator+=(const basic_Point3D &o){ X += o.X; Y += o.Y; Z += o.Z; return *this; }
+            basic_Point3D &operator-=(const basic_Point3D &o){ X -= o.X; Y -= o.Y; Z -= o.Z; return *this; }
+
+            template<class O_>
+            basic_Point3D &operator*=(O_ s){ X *= s; Y *= s; Z *= s; return *this; }
+
+            bool operator==(const basic_Point3D &o) const{ return X == o.X && Y == o.Y && Z == o.Z; }
+            bool operator!=(const basic_Point3D &o) const{ return !(*this == o); }
+
+            T_ Distance() const{ return std::sqrt(X * X + Y * Y + Z * Z); }
+            T_ Distance(const basic_Point3D &o) const{ return (*this - o).Distance(); }
+
+            void Normalize(){
+                T_ d = Distance();
+                if(d){ X /= d; Y /= d; Z /= d; }
+            }
+            basic_Point3D Normalized() const{
+                basic_Point3D c = *this;
+                c.Normalize();
+                return c;
+            }
+        };
+
+        typedef basic_Point3D<float> Point3D;
+    }
+}
@@ -0,0 +1,7 @@
+/**
+ * @file Assert.h is a minimal stand-in for the Gorgon assert header
+ */
+#pragma once
+
+#include <cassert>
+#include <stdexcept>
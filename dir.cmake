@@ -1,12 +1,51 @@
 SET(Local
     particle.h
     particle.cpp
+    pstore.h
+    pstore.cpp
+    pintegrate.h
+    pintegrate.cpp
+    pintegrators.h
+    pimplicit.h
+    pimplicit.cpp
     pcontacts.h
     pcontacts.cpp
+    pcollide.h
+    pcollide.cpp
+    pstatic.h
+    pstatic.cpp
     pfgen.h
     pfgen.cpp
+    pemitter.h
+    pemitter.cpp
     plinks.h
     plinks.cpp
     pworld.h
     pworld.cpp
+    pasync.h
+    pasync.cpp
+    pjobs.h
+    pjobs.cpp
+    preal.h
+    psnapshot.h
+    psnapshot.cpp
+    pstats.h
+    pislands.h
+    pislands.cpp
+    pxpbd.h
+    pxpbd.cpp
 )
+
+# Build options of the physics module. They change the layout of public
+# classes, so they are defined for everything built from here on; code that
+# uses the module must be built with the same definitions. A binary holds
+# either the 2D or the 3D build of the module, not both.
+option(GORGON_PHYSICS_FLOAT "Use float as the real type of the physics module" OFF)
+option(GORGON_PHYSICS_2D "Build the physics module with two axes" OFF)
+
+if(GORGON_PHYSICS_FLOAT)
+    add_definitions(-DGORGON_PHYSICS_FLOAT)
+endif()
+if(GORGON_PHYSICS_2D)
+    add_definitions(-DGORGON_PHYSICS_2D)
+endif()
@@ -9,46 +9,99 @@
 
 using Gorgon::Geometry::Point3D;
 using Gorgon::Physics::Particle;
+using Gorgon::Physics::ParticleStore;
 
-void Particle::Integrator(unsigned long time)
+Particle::Particle()
+: store(&ParticleStore::Detached()), index(store->Create())
 {
-    // don't integrate particles with zero mass
-    if (inverseMass <= 0.0f)
-        return;
+    owned = store->GetHandle(index);
+}
 
-    // abort the program if the time elapsed
-    // between frames is less than zero
-    if(time < 0.0)
-        throw std::runtime_error("time cannot be less than zero");
+Particle::Particle(ParticleStore &store, unsigned index)
+: store(&store), index(index)
+{
+}
+
+Particle::Particle(const Particle &other)
+: store(other.store), index(other.index)
+{
+}
+
+Particle::Particle(Particle &&other) noexcept
+: store(other.store), index(other.index), owned(other.owned)
+{
+    other.owned = ParticleHandle();
+}
 
-    /**
-     * Update linear position
-     * we don't pay attiention to the accleration in the position update
-     * because the resulting acceleration would be very small due
-     * the smale time intervals so it wouldn't have impact,
-     * we will take it into consideration in the velocity update
-     */
+Particle &Particle::operator=(const Particle &other)
+{
+    if(this == &other) return *this;
 
-    /// TODO create a function to add a scaled vector directly, ex addScaledVector(vecotr, scale)
-    position = position + (velocity * time);
+    release();
+    store = other.store;
+    index = other.index;
 
-    // work out the acceleratino from the applied force
-    Point3D resultingAcceleration = acceleration;
+    return *this;
+}
 
-    // add to the resulting acceleration force scaled with the inverse mass
-    resultingAcceleration = resultingAcceleration + (forceAccum * inverseMass);
+Particle &Particle::operator=(Particle &&other) noexcept
+{
+    if(this == &other) return *this;
 
-    // update the velcity
-    velocity = velocity + (resultingAcceleration * time);
+    release();
+    store = other.store;
+    index = other.index;
+    owned = other.owned;
+    other.owned = ParticleHandle();
 
-    // impose damping (drag)
-    // impose drag by each frame instead of per intervals of time.
-    velocity = velocity * pow(damping, time);
+    return *this;
+}
 
-    // clear the accumulated forces
-    ClearAccumulator();
+Particle::~Particle()
+{
+    release();
+}
+
+void Particle::release()
+{
+    // the handle doesn't match if the slot is attached to a world
+    // or released through a copy
+    if(owned != ParticleHandle() && store->Find(owned) == index)
+        store->Release(index);
+
+    owned = ParticleHandle();
+}
+
+void Particle::Integrator(double time)
+{
+    store->Integrate(index, time);
 };
 
+void Particle::Attach(ParticleStore &target)
+{
+    if(store == &target) return;
+
+    unsigned slot = target.Create();
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+    {
+        target.position[a][slot] = store->position[a][index];
+        target.previous[a][slot] = store->previous[a][index];
+        target.velocity[a][slot] = store->velocity[a][index];
+        target.acceleration[a][slot] = store->acceleration[a][index];
+        target.forceAccum[a][slot] = store->forceAccum[a][index];
+    }
+    target.inverseMass[slot] = store->inverseMass[index];
+    target.damping[slot] = store->damping[index];
+    target.radius[slot] = store->radius[index];
+    target.asleep[slot] = store->asleep[index];
+    target.views[slot] = this;
+
+    store->Release(index);
+    store = &target;
+    index = slot;
+    owned = ParticleHandle();
+}
+
 // void Particle::SetMass(const double value)
 // {
 //     assert(value != 0);
@@ -16,30 +16,72 @@
 #pragma once
 
 #include <Gorgon/Geometry/Point3D.h>
+#include <Gorgon/Physics/pstore.h>
 #include <assert.h>
+#include <limits>
 using Gorgon::Geometry::Point3D;
 namespace Gorgon
 {
     namespace Physics
     {
+        /**
+         * A particle is a view over a slot in a ParticleStore. The state
+         * of the particle lives in the store, the particle object only
+         * keeps the store and the index of its slot. Copying a particle
+         * copies the view, both copies refer to the same particle.
+         *
+         * A particle that is created on its own lives in the detached
+         * store until it's attached to a world. That particle object owns
+         * its detached slot and releases it when it's destroyed, so its
+         * copies shouldn't outlive it; moving the particle moves the
+         * ownership.
+         */
         class Particle
         {
+            friend class ParticleStore;
+
         protected:
-            double inverseMass;
-            double damping;
+            ParticleStore *store;
+            unsigned index;
 
-            Point3D position;
-            Point3D velocity;
-            Point3D acceleration;
+            /**
+             * Handle of the detached slot this object created, it's
+             * released with the object
+             */
+            ParticleHandle owned;
 
             /**
-             * this variable holds the accumulated force that to
-             * be applied in the next frame update.
-             * it's also cleared by each frame.
+             * Releases the detached slot if this object owns it
              */
-            Point3D forceAccum;
+            void release();
 
         public:
+            /**
+             * Creates a new particle in the detached store
+             */
+            Particle();
+
+            /**
+             * Creates a view over an existing slot in the given store
+             */
+            Particle(ParticleStore &store, unsigned index);
+
+            /**
+             * Creates a view over the slot of the given particle
+             */
+            Particle(const Particle &other);
+
+            /**
+             * Takes over the slot of the given particle, including its
+             * detached slot if it owns one
+             */
+            Particle(Particle &&other) noexcept;
+
+            Particle &operator=(const Particle &other);
+            Particle &operator=(Particle &&other) noexcept;
+
+            ~Particle();
+
             /*
              * This function performs mathematical integration
              * by working out the acceleration from the force
@@ -47,68 +89,133 @@ namespace Gorgon
              * the acceleration and then update the position
              * with the velocity
              */
-            void Integrator(unsigned long time);
+            void Integrator(double time);
+
+            /**
+             * Moves the state of this particle into a new slot in the
+             * given store. The old slot is released.
+             */
+            void Attach(ParticleStore &target);
+
+            inline ParticleStore &GetStore() const{
+                return *store;
+            };
+            inline unsigned GetIndex() const{
+                return index;
+            };
+            inline bool IsIn(const ParticleStore &target) const{
+                return store == &target;
+            };
+
+            /**
+             * Returns the handle of this particle in its store
+             */
+            inline ParticleHandle GetHandle() const{
+                return store->GetHandle(index);
+            };
 
-            inline void SetMass(const double value){
+            inline void SetMass(const real value){
                 assert(value != 0);
-                inverseMass = (1.0f / value);
+                store->inverseMass[index] = (1.0f / value);
             };
-            inline double GetMass() const{
+            inline real GetMass() const{
                 // if the inverse mass is zero, that means it has infinite mass
-                if (inverseMass == 0){
-                    return std::numeric_limits<double>::max();
+                if (store->inverseMass[index] == 0){
+                    return std::numeric_limits<real>::max();
                 } else{
-                    return (1.0f / inverseMass);
+                    return (1.0f / store->inverseMass[index]);
                 }
             };
 
-            inline void SetInverseMass(const double value){
-                inverseMass = value;
+            inline void SetInverseMass(const real value){
+                store->inverseMass[index] = value;
+            };
+            inline real GetInverseMass() const{
+                return store->inverseMass[index];
+            };
+
+            inline void SetDamping(const real value){
+                store->damping[index] = value;
+            };
+            inline real GetDamping() const{
+                return store->damping[index];
+            };
+
+            inline void SetRadius(const real value){
+                store->radius[index] = value;
             };
-            inline double GetInverseMass() const{
-                return inverseMass;
+            inline real GetRadius() const{
+                return store->radius[index];
             };
 
-            inline void SetDamping(const double value){
-                damping = value;
+            /**
+             * Sleeping particles are skipped by the integrator, the force
+             * registry and the contact generators. Setting the position or
+             * the velocity of a particle, or adding a force to it, wakes it up.
+             */
+            inline void SetAwake(const bool value){
+                store->asleep[index] = !value;
             };
-            inline double GetDamping() const{
-                return damping;
+            inline bool IsAwake() const{
+                return !store->asleep[index];
             };
 
             inline void SetPosition(const Point3D &value){
-                position = value;
+                store->SetPosition(index, value);
+                store->asleep[index] = 0;
             };
             inline void SetPosition(const int &x, const int &y){
-                position.X = x;
-                position.Y = y;
+                SetPosition(Point3D(x, y, 0));
             }
             inline Point3D GetPosition() const{
-                return position;
+                return store->GetPosition(index);
+            };
+
+            /**
+             * Moves the particle to the given position without
+             * interpolating from where it was, for moves from outside of
+             * the simulation such as placing or respawning a particle.
+             * The solvers move the particles with SetPosition.
+             */
+            inline void Teleport(const Point3D &value){
+                SetPosition(value);
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    store->previous[a][index] = store->position[a][index];
+            };
+
+            /**
+             * Returns the position between the last two physics steps,
+             * alpha 0 is the previous step and 1 is the current one.
+             * Use the alpha that ParticleWorld::GetAlpha returns.
+             */
+            inline Point3D GetInterpolatedPosition(double alpha) const{
+                return store->GetInterpolatedPosition(index, alpha);
             };
 
             inline void SetVelocity(const Point3D &value){
-                velocity = value;
+                store->SetVelocity(index, value);
+                store->asleep[index] = 0;
             };
             inline Point3D GetVelocity() const{
-                return velocity;
+                return store->GetVelocity(index);
             };
 
             inline void SetAcceleration(const Point3D &value){
-                acceleration = value;
+                store->SetAcceleration(index, value);
             };
             inline Point3D GetAcceleration() const{
-                return acceleration;
+                return store->GetAcceleration(index);
             };
 
             inline void ClearAccumulator(){
-                forceAccum = {0, 0, 0};
+                store->ClearAccumulator(index);
             };
             inline void AddForce(const Point3D &force){
-                forceAccum = forceAccum + force ;
+                store->AddForce(index, force);
+                store->asleep[index] = 0;
             };
             inline bool HasFiniteMass() const{
-                return (inverseMass >= 0.0f);
+                return (store->inverseMass[index] > 0.0f);
             };
         };  
     }
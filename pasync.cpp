@@ -0,0 +1,196 @@
+/**
+ * @file pasync.cpp is the implementation for pasync.h
+ */
+#include <Gorgon/Physics/pasync.h>
+#include <stdexcept>
+
+using Gorgon::Physics::ParticleWorldWorker;
+using Gorgon::Physics::ParticleHandle;
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::Particle;
+
+ParticleWorldWorker::ParticleWorldWorker(ParticleWorld &world, unsigned queueSize)
+: world(world)
+{
+    unsigned size = 1;
+    while(size < queueSize)
+        size *= 2;
+
+    inputs.resize(size);
+    mask = size - 1;
+
+    // the reader sees the world as it is until the first step
+    publish();
+    GetFrame();
+
+    thread = std::thread(&ParticleWorldWorker::work, this);
+}
+
+ParticleWorldWorker::~ParticleWorldWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start.notify_one();
+
+    thread.join();
+}
+
+void ParticleWorldWorker::Step(double elapsed)
+{
+    // checked here, the worker thread has no one to throw to
+    if(elapsed < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending += elapsed;
+        requested = true;
+        busy = true;
+    }
+    start.notify_one();
+}
+
+void ParticleWorldWorker::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{ return !busy; });
+
+    if(error)
+    {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+bool ParticleWorldWorker::IsBusy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busy;
+}
+
+bool ParticleWorldWorker::Post(Command command)
+{
+    unsigned at = tail.load(std::memory_order_relaxed);
+    if(at - head.load(std::memory_order_acquire) > mask)
+        return false;
+
+    Input &input = inputs[at & mask];
+    input.particle = ParticleHandle();
+    input.command = std::move(command);
+
+    tail.store(at + 1, std::memory_order_release);
+    return true;
+}
+
+bool ParticleWorldWorker::AddForce(ParticleHandle particle, const Point3D &force)
+{
+    unsigned at = tail.load(std::memory_order_relaxed);
+    if(at - head.load(std::memory_order_acquire) > mask)
+        return false;
+
+    Input &input = inputs[at & mask];
+    input.particle = particle;
+    input.force = force;
+
+    tail.store(at + 1, std::memory_order_release);
+    return true;
+}
+
+void ParticleWorldWorker::drain()
+{
+    unsigned at = head.load(std::memory_order_relaxed);
+    unsigned end = tail.load(std::memory_order_acquire);
+
+    for(; at != end; at++)
+    {
+        Input &input = inputs[at & mask];
+
+        // the input is taken out of the ring before it's run, so a
+        // command that throws isn't run again
+        Command command;
+        command.swap(input.command);
+        ParticleHandle handle = input.particle;
+        Point3D force = input.force;
+        head.store(at + 1, std::memory_order_release);
+
+        if(command)
+        {
+            command(world);
+        }
+        else
+        {
+            Particle *particle = world.GetParticle(handle);
+            if(particle != nullptr)
+                particle->AddForce(force);
+        }
+    }
+}
+
+void ParticleWorldWorker::publish()
+{
+    const ParticleStore &store = world.GetStore();
+    Frame &frame = frames[back];
+
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+    {
+        frame.position[a] = store.position[a];
+        frame.previous[a] = store.previous[a];
+        frame.velocity[a] = store.velocity[a];
+    }
+    frame.alpha = world.GetAlpha();
+    frame.steps = steps;
+
+    back = ready.exchange(back | Fresh, std::memory_order_acq_rel) & ~Fresh;
+}
+
+const ParticleWorldWorker::Frame &ParticleWorldWorker::GetFrame()
+{
+    if(ready.load(std::memory_order_relaxed) & Fresh)
+        front = ready.exchange(front, std::memory_order_acq_rel) & ~Fresh;
+
+    return frames[front];
+}
+
+void ParticleWorldWorker::work()
+{
+    while(true)
+    {
+        double elapsed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [this]{ return quit || requested; });
+            if(quit && !requested) break;
+
+            elapsed = pending;
+            pending = 0;
+            requested = false;
+        }
+
+        std::exception_ptr thrown;
+        try
+        {
+            drain();
+            world.Step(elapsed);
+            steps++;
+            publish();
+        }
+        catch(...)
+        {
+            thrown = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(thrown && !error)
+                error = thrown;
+
+            // another step may have been asked for while stepping
+            if(requested) continue;
+            busy = false;
+        }
+        done.notify_all();
+    }
+}
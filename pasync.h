@@ -0,0 +1,230 @@
+/**
+ * @file pasync.h contains the ParticleWorldWorker class
+ *
+ * @brief The worker runs the steps of a particle world on a thread of its
+ * own so the physics overlaps with the rest of the frame of the game, such
+ * as rendering. The game thread hands it the elapsed time of each frame
+ * and goes on; the worker steps the world and publishes the positions and
+ * velocities of the particles to a triple buffer. The game thread reads
+ * the latest published frame without waiting for the worker, and the
+ * worker never waits for the reader.
+ *
+ * While the worker runs, the world belongs to it. The game thread queues
+ * its inputs, forces and anything else that changes the world, and the
+ * worker applies them before its next step. The queue is a lock-free
+ * single producer ring, so the inputs should be queued from one thread.
+ * The world can be used directly again after Wait returns.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pworld.h>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ParticleWorldWorker
+        {
+        public:
+            /**
+             * A change to the world that's run on the worker thread
+             * before the next step
+             */
+            typedef std::function<void(ParticleWorld &world)> Command;
+
+            /**
+             * The state of the particles after a step, read-only for the
+             * game thread. Particles are addressed by their index in the
+             * store at the time of the step.
+             */
+            struct Frame
+            {
+                std::vector<real> position[ParticleStore::Axes];
+                std::vector<real> previous[ParticleStore::Axes];
+                std::vector<real> velocity[ParticleStore::Axes];
+
+                /**
+                 * Interpolation alpha of the world after the step, see
+                 * ParticleWorld::GetAlpha
+                 */
+                double alpha = 1;
+
+                /**
+                 * Number of calls to ParticleWorld::Step that are done
+                 * before this frame
+                 */
+                unsigned long steps = 0;
+
+                inline unsigned GetCount() const{
+                    return (unsigned)velocity[0].size();
+                };
+
+                inline Point3D GetPosition(unsigned index) const{
+                    return get(position, index);
+                };
+
+                inline Point3D GetVelocity(unsigned index) const{
+                    return get(velocity, index);
+                };
+
+                /**
+                 * Returns the position between the two last steps for
+                 * the alpha of the frame
+                 */
+                inline Point3D GetInterpolatedPosition(unsigned index) const{
+                    real p[ParticleStore::Axes];
+                    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                        p[a] = previous[a][index] + (position[a][index] - previous[a][index]) * alpha;
+                    return ParticleStore::ToPoint(p);
+                };
+
+            private:
+                static inline Point3D get(const std::vector<real> (&arr)[ParticleStore::Axes], unsigned index){
+                    real values[ParticleStore::Axes];
+                    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                        values[a] = arr[a][index];
+                    return ParticleStore::ToPoint(values);
+                };
+            };
+
+            /**
+             * Starts a worker thread for the given world. The queue can
+             * hold the given number of inputs, rounded up to a power of
+             * two. The current state of the world is published as the
+             * first frame.
+             */
+            ParticleWorldWorker(ParticleWorld &world, unsigned queueSize = 4096);
+
+            /**
+             * Runs the step that's asked for, if any, and stops the
+             * thread. Errors of that step are dropped.
+             */
+            ~ParticleWorldWorker();
+
+            ParticleWorldWorker(const ParticleWorldWorker &) = delete;
+            ParticleWorldWorker &operator=(const ParticleWorldWorker &) = delete;
+
+            /**
+             * Hands the elapsed time of a frame to the worker and returns
+             * right away. The worker runs ParticleWorld::Step with it; if
+             * the worker is still busy with an earlier step, the times
+             * are added up for the next one. Throws if the time is less
+             * than zero.
+             */
+            void Step(double elapsed);
+
+            /**
+             * Waits until the worker has run all the steps it's given.
+             * The world can be used directly until the next Step. If a
+             * step or a queued command has thrown since the last call,
+             * the exception is thrown from here; the worker goes on with
+             * the next step regardless.
+             */
+            void Wait();
+
+            /**
+             * Returns whether the worker is stepping the world
+             */
+            bool IsBusy();
+
+            /**
+             * Queues a change to the world. Returns false if the queue
+             * is full, in which case the command is not queued.
+             */
+            bool Post(Command command);
+
+            /**
+             * Queues a force on the particle with the given handle. It's
+             * added before the next step, and ignored if the particle is
+             * removed by then. Returns false if the queue is full.
+             */
+            bool AddForce(ParticleHandle particle, const Point3D &force);
+
+            /**
+             * Returns the latest published frame. The frame stays
+             * unchanged until the next call to GetFrame.
+             */
+            const Frame &GetFrame();
+
+        protected:
+            void work();
+
+            /**
+             * Runs the queued inputs
+             */
+            void drain();
+
+            /**
+             * Copies the state of the world to the back frame and
+             * publishes it
+             */
+            void publish();
+
+            ParticleWorld &world;
+
+            /**
+             * An input of the queue, either a force on a particle or
+             * a command
+             */
+            struct Input
+            {
+                ParticleHandle particle;
+                Point3D force;
+                Command command;
+            };
+
+            /**
+             * Ring of inputs, the game thread writes at tail and the
+             * worker reads at head
+             */
+            std::vector<Input> inputs;
+            unsigned mask;
+            std::atomic<unsigned> head{0}, tail{0};
+
+            /**
+             * Triple buffer of frames. The worker fills the back frame,
+             * the reader holds the front frame, and the third one is the
+             * latest published frame, which is swapped with either side.
+             * The Fresh bit marks a published frame the reader hasn't
+             * taken yet.
+             */
+            static const unsigned Fresh = 4;
+            Frame frames[3];
+            unsigned back = 0, front = 2;
+            std::atomic<unsigned> ready{1};
+            unsigned long steps = 0;
+
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable start, done;
+
+            /**
+             * Time given to the worker that's not stepped yet
+             */
+            double pending = 0;
+
+            /**
+             * The first error of a step since the last Wait
+             */
+            std::exception_ptr error;
+
+            /**
+             * True when Step is called after the worker took the time
+             */
+            bool requested = false;
+
+            /**
+             * True from Step until the worker has run all steps
+             */
+            bool busy = false;
+            bool quit = false;
+        };
+    }
+}
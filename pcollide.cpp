@@ -0,0 +1,393 @@
+/**
+ * @file pcollide.cpp is the implementation for pcollide.h
+ */
+#include <Gorgon/Physics/pcollide.h>
+#include <Gorgon/Physics/particle.h>
+#include <cmath>
+
+using Gorgon::Geometry::Point3D;
+using namespace Gorgon::Physics;
+
+namespace
+{
+    /**
+     * Tests the given pair of particles as spheres and fills the
+     * contact if they overlap. Returns whether a contact is written.
+     */
+    bool collide(const ParticleStore &store, unsigned i, unsigned j,
+                 real restitution, ParticleContact *contact)
+    {
+        real d[ParticleStore::Axes], distSq = 0;
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        {
+            d[a] = store.position[a][i] - store.position[a][j];
+            distSq += d[a] * d[a];
+        }
+
+        real reach = store.radius[i] + store.radius[j];
+        if(distSq >= reach * reach) return false;
+
+        // the normal points from the second particle to the first
+        real dist = std::sqrt(distSq);
+        Point3D normal(0, 1, 0);
+        if(dist > 0)
+            normal = ParticleStore::ToPoint(d) / dist;
+
+        contact->particle[0] = store.views[i];
+        contact->particle[1] = store.views[j];
+        contact->ContactNormal = normal;
+        contact->penetration = reach - dist;
+        contact->restitution = restitution;
+
+        return true;
+    }
+
+    inline bool isColliding(const ParticleStore &store, unsigned i)
+    {
+        return store.radius[i] > 0 && store.views[i] != nullptr;
+    }
+
+    /**
+     * Pairs of sleeping particles don't need contacts
+     */
+    inline bool isAsleep(const ParticleStore &store, unsigned i, unsigned j)
+    {
+        return store.asleep[i] && store.asleep[j];
+    }
+}
+
+const unsigned ParticleCollisions::NoBucket;
+
+ParticleCollisions::ParticleCollisions(ParticleStore &store, real restitution)
+: restitution(restitution), store(store)
+{
+}
+
+void ParticleCollisions::build() const
+{
+    unsigned count = store.GetCount();
+
+    // the cells should hold the largest particle
+    real maxRadius = 0;
+    unsigned colliding = 0;
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(!isColliding(store, i)) continue;
+
+        colliding++;
+        if(store.radius[i] > maxRadius)
+            maxRadius = store.radius[i];
+    }
+
+    real size = cellSize < 2 * maxRadius ? 2 * maxRadius : cellSize;
+
+    // twice as many buckets as particles keeps the collisions low
+    buckets = 1;
+    while(buckets < colliding * 2)
+        buckets <<= 1;
+
+    bucketOf.resize(count);
+    bucketStart.assign(buckets + 1, 0);
+    sorted.resize(colliding);
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        cell[a].resize(count);
+
+    if(colliding == 0) return;
+
+    // count the particles in each bucket
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(!isColliding(store, i))
+        {
+            bucketOf[i] = NoBucket;
+            continue;
+        }
+
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+            cell[a][i] = (long)std::floor(store.position[a][i] / size);
+
+        bucketOf[i] = bucket(cell[0][i], cell[1][i], cellZ(i));
+        bucketStart[bucketOf[i]]++;
+    }
+
+    // running sum gives where each bucket ends
+    for(unsigned b = 1; b < buckets; b++)
+        bucketStart[b] += bucketStart[b - 1];
+    bucketStart[buckets] = colliding;
+
+    // scatter the particles into their buckets, walking backwards keeps
+    // the particles in a bucket in the order of their indices and leaves
+    // bucketStart pointing to the start of each bucket
+    for(unsigned i = count; i-- > 0;)
+    {
+        if(bucketOf[i] == NoBucket) continue;
+        sorted[--bucketStart[bucketOf[i]]] = i;
+    }
+}
+
+unsigned ParticleCollisions::AddContact(ParticleContact *contact, unsigned limit) const
+{
+    build();
+
+    unsigned count = 0;
+    if(sorted.empty()) return 0;
+
+    // buckets of the neighbouring cells, a bucket may be reached
+    // from more than one cell when the hash collides. The 2D build
+    // only has the neighbours in the same layer.
+    const long depth = ParticleStore::Axes > 2 ? 1 : 0;
+    unsigned visited[27];
+
+    for(unsigned i : sorted)
+    {
+        unsigned numVisited = 0;
+
+        for(long dx = -1; dx <= 1; dx++)
+        for(long dy = -1; dy <= 1; dy++)
+        for(long dz = -depth; dz <= depth; dz++)
+        {
+            unsigned b = bucket(cell[0][i] + dx, cell[1][i] + dy, cellZ(i) + dz);
+
+            bool seen = false;
+            for(unsigned v = 0; v < numVisited; v++)
+                if(visited[v] == b) seen = true;
+            if(seen) continue;
+            visited[numVisited++] = b;
+
+            for(unsigned k = bucketStart[b]; k < bucketStart[b + 1]; k++)
+            {
+                unsigned j = sorted[k];
+
+                // each pair is tested once
+                if(j <= i) continue;
+
+                if(isAsleep(store, i, j)) continue;
+
+                if(!collide(store, i, j, restitution, contact)) continue;
+
+                contact++;
+                count++;
+
+                if(count >= limit) return count;
+            }
+        }
+    }
+
+    return count;
+}
+
+
+ParticleSweepAndPrune::ParticleSweepAndPrune(ParticleStore &store, unsigned axes, real restitution)
+: restitution(restitution), store(store), axes(axes < 1 ? 1 : axes > 2 ? 2 : axes)
+{
+}
+
+void ParticleSweepAndPrune::track() const
+{
+    unsigned count = store.GetCount();
+
+    // the store has shrunk without a compaction, such as by Clear, so the
+    // slots that are left may hold other particles too: start over
+    if(count < tracked.size())
+    {
+        for(unsigned a = 0; a < axes; a++)
+            endpoints[a].clear();
+
+        tracked.clear();
+        pairs.clear();
+        pairIndex.clear();
+    }
+
+    tracked.resize(count, 0);
+
+    bool removed = false;
+    for(unsigned i = 0; i < count; i++)
+    {
+        bool colliding = isColliding(store, i);
+        if(colliding == (bool)tracked[i]) continue;
+
+        tracked[i] = colliding;
+
+        // new endpoints are appended, the insertion sort moves them
+        // into place and adds their pairs
+        if(colliding)
+        {
+            for(unsigned a = 0; a < axes; a++)
+            {
+                endpoints[a].push_back({0, i, false});
+                endpoints[a].push_back({0, i, true});
+            }
+        }
+        else
+        {
+            removed = true;
+        }
+    }
+
+    if(!removed) return;
+
+    for(unsigned a = 0; a < axes; a++)
+    {
+        std::vector<Endpoint> &list = endpoints[a];
+        unsigned kept = 0;
+        for(const Endpoint &e : list)
+            if(e.particle < count && tracked[e.particle])
+                list[kept++] = e;
+        list.resize(kept);
+    }
+
+    for(unsigned p = 0; p < pairs.size();)
+    {
+        if(tracked[pairs[p].first] && tracked[pairs[p].second])
+            p++;
+        else
+            removePair(pairs[p].first, pairs[p].second);
+    }
+}
+
+void ParticleSweepAndPrune::Remap(const ParticleStore &store, const std::vector<unsigned> &remap)
+{
+    if(&store != &this->store) return;
+
+    auto moved = [&remap](unsigned index){
+        return index < remap.size() ? remap[index] : ParticleStore::NoIndex;
+    };
+
+    // the slots keep their order, so the endpoints stay sorted
+    for(unsigned a = 0; a < axes; a++)
+    {
+        std::vector<Endpoint> &list = endpoints[a];
+        unsigned kept = 0;
+        for(Endpoint e : list)
+        {
+            e.particle = moved(e.particle);
+            if(e.particle != ParticleStore::NoIndex)
+                list[kept++] = e;
+        }
+        list.resize(kept);
+    }
+
+    std::vector<char> was;
+    was.swap(tracked);
+    tracked.assign(store.GetCount(), 0);
+    for(unsigned i = 0; i < was.size(); i++)
+    {
+        unsigned index = moved(i);
+        if(was[i] && index != ParticleStore::NoIndex)
+            tracked[index] = 1;
+    }
+
+    std::vector<std::pair<unsigned, unsigned>> old;
+    old.swap(pairs);
+    pairIndex.clear();
+    for(const std::pair<unsigned, unsigned> &p : old)
+    {
+        unsigned i = moved(p.first), j = moved(p.second);
+        if(i != ParticleStore::NoIndex && j != ParticleStore::NoIndex)
+            addPair(i, j);
+    }
+}
+
+bool ParticleSweepAndPrune::overlapsOthers(unsigned i, unsigned j, unsigned axis) const
+{
+    for(unsigned a = 0; a < axes; a++)
+    {
+        if(a == axis) continue;
+
+        real reach = store.radius[i] + store.radius[j];
+        if(std::abs(store.position[a][i] - store.position[a][j]) > reach)
+            return false;
+    }
+
+    return true;
+}
+
+void ParticleSweepAndPrune::sortAxis(unsigned axis) const
+{
+    std::vector<Endpoint> &list = endpoints[axis];
+
+    for(Endpoint &e : list)
+    {
+        real r = store.radius[e.particle];
+        e.value = store.position[axis][e.particle] + (e.max ? r : -r);
+    }
+
+    for(unsigned k = 1; k < list.size(); k++)
+    {
+        Endpoint e = list[k];
+        unsigned m = k;
+
+        while(m > 0 && list[m - 1].value > e.value)
+        {
+            const Endpoint &other = list[m - 1];
+
+            // a min moving before a max starts an overlap on this axis,
+            // a max moving before a min ends it
+            if(!e.max && other.max)
+            {
+                if(overlapsOthers(e.particle, other.particle, axis))
+                    addPair(e.particle, other.particle);
+            }
+            else if(e.max && !other.max)
+            {
+                removePair(e.particle, other.particle);
+            }
+
+            list[m] = other;
+            m--;
+        }
+
+        list[m] = e;
+    }
+}
+
+void ParticleSweepAndPrune::addPair(unsigned i, unsigned j) const
+{
+    if(i == j) return;
+
+    unsigned long long k = key(i, j);
+    if(pairIndex.count(k)) return;
+
+    pairIndex[k] = (unsigned)pairs.size();
+    pairs.push_back({i < j ? i : j, i < j ? j : i});
+}
+
+void ParticleSweepAndPrune::removePair(unsigned i, unsigned j) const
+{
+    auto itr = pairIndex.find(key(i, j));
+    if(itr == pairIndex.end()) return;
+
+    // swap with the last pair and drop it
+    unsigned index = itr->second;
+    pairIndex.erase(itr);
+
+    if(index != pairs.size() - 1)
+    {
+        pairs[index] = pairs.back();
+        pairIndex[key(pairs[index].first, pairs[index].second)] = index;
+    }
+    pairs.pop_back();
+}
+
+unsigned ParticleSweepAndPrune::AddContact(ParticleContact *contact, unsigned limit) const
+{
+    track();
+
+    for(unsigned a = 0; a < axes; a++)
+        sortAxis(a);
+
+    unsigned count = 0;
+    for(const std::pair<unsigned, unsigned> &p : pairs)
+    {
+        if(count >= limit) break;
+
+        if(isAsleep(store, p.first, p.second)) continue;
+
+        if(!collide(store, p.first, p.second, restitution, contact)) continue;
+
+        contact++;
+        count++;
+    }
+
+    return count;
+}
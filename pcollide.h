@@ -0,0 +1,222 @@
+/**
+ * @file pcollide.h contains the particle-particle collision generators
+ *
+ * @brief Particles that have a collision radius collide with each other
+ * as spheres. Testing every pair of particles is O(n²), so the
+ * generators here use a broad-phase to find the pairs that are
+ * close enough to overlap, and only these pairs are tested.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pcontacts.h>
+#include <Gorgon/Physics/pstore.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        /**
+         * Collides the particles of a store using a uniform spatial hash
+         * grid. The grid is rebuilt each frame with a counting sort; each
+         * particle is placed into the cell of its center and is tested
+         * against the particles of the neighbouring cells only.
+         */
+        class ParticleCollisions : public ParticleContactGenerator
+        {
+        public:
+            /**
+             * Creates a collision generator for the particles in the
+             * given store.
+             */
+            ParticleCollisions(ParticleStore &store, real restitution = 0.2);
+
+            /**
+             * Holds the restitution for the collisions
+             */
+            real restitution;
+
+            /**
+             * Sets the size of the grid cells. Cells are never smaller
+             * than the diameter of the largest particle. Zero (the
+             * default) uses the diameter of the largest particle.
+             */
+            inline void SetCellSize(real value){
+                cellSize = value;
+            };
+            inline real GetCellSize() const{
+                return cellSize;
+            };
+
+            /**
+             * Rebuilds the grid and fills the given contact array with
+             * the contacts of the overlapping particles.
+             */
+            virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const;
+
+        protected:
+            ParticleStore &store;
+
+            real cellSize = 0;
+
+            /**
+             * Rebuilds the grid from the current positions
+             */
+            void build() const;
+
+            /**
+             * Returns the bucket of the given cell
+             */
+            inline unsigned bucket(long x, long y, long z) const{
+                unsigned long h = (unsigned long)x * 73856093UL ^
+                                  (unsigned long)y * 19349663UL ^
+                                  (unsigned long)z * 83492791UL;
+                return (unsigned)(h & (buckets - 1));
+            };
+
+            /**
+             * Returns the Z cell of the given particle, zero in the 2D build
+             */
+            inline long cellZ(unsigned i) const{
+                return ParticleStore::Axes > 2 ? cell[ParticleStore::Axes - 1][i] : 0;
+            };
+
+            /**
+             * Number of buckets in the hash table, always a power of two
+             */
+            mutable unsigned buckets = 0;
+
+            /**
+             * Holds the cell of each particle, one array per axis
+             */
+            mutable std::vector<long> cell[ParticleStore::Axes];
+
+            /**
+             * Holds the bucket of each particle, or NoBucket if the
+             * particle doesn't collide.
+             */
+            mutable std::vector<unsigned> bucketOf;
+
+            /**
+             * Holds where each bucket starts in the sorted array
+             */
+            mutable std::vector<unsigned> bucketStart;
+
+            /**
+             * Holds the colliding particles sorted by their buckets
+             */
+            mutable std::vector<unsigned> sorted;
+
+            static const unsigned NoBucket = (unsigned)-1;
+        };
+
+        /**
+         * Collides the particles of a store using incremental sweep and
+         * prune. The bounding box endpoints of the particles are kept
+         * sorted along one or two axes (X, then Y) across the frames.
+         * Since particles move little from one frame to the next, an
+         * insertion sort brings the endpoints back in order in nearly
+         * linear time. Every swap of a min and a max endpoint adds or
+         * removes a pair from a persistent set of overlapping pairs, so
+         * only the pairs whose boxes overlap are ever tested.
+         *
+         * This generator is a better fit than ParticleCollisions for
+         * scenes that mostly rest or move slowly, such as stacks.
+         */
+        class ParticleSweepAndPrune : public ParticleContactGenerator
+        {
+        public:
+            /**
+             * Creates a sweep and prune generator for the particles in
+             * the given store, sorting along the given number of axes.
+             */
+            ParticleSweepAndPrune(ParticleStore &store, unsigned axes = 2, real restitution = 0.2);
+
+            /**
+             * Holds the restitution for the collisions
+             */
+            real restitution;
+
+            /**
+             * Returns the number of pairs whose boxes overlapped
+             * during the last update.
+             */
+            inline unsigned GetPairCount() const{
+                return (unsigned)pairs.size();
+            };
+
+            /**
+             * Updates the sorted endpoints and the pair set, then fills
+             * the given contact array with the contacts of the pairs
+             * that actually overlap.
+             */
+            virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const;
+
+            /**
+             * Moves the endpoints and the pairs to the new indices of
+             * their particles, the removed particles are dropped
+             */
+            virtual void Remap(const ParticleStore &store, const std::vector<unsigned> &remap) override;
+
+        protected:
+            /**
+             * Start or end of the bounding box of a particle on an axis
+             */
+            struct Endpoint
+            {
+                real value;
+                unsigned particle;
+                bool max;
+            };
+
+            ParticleStore &store;
+
+            unsigned axes;
+
+            /**
+             * Holds the sorted endpoints of each axis
+             */
+            mutable std::vector<Endpoint> endpoints[2];
+
+            /**
+             * Whether a slot has its endpoints in the lists
+             */
+            mutable std::vector<char> tracked;
+
+            /**
+             * Holds the pairs whose boxes overlap. The index of each
+             * pair is kept in pairIndex so a pair can be removed in O(1).
+             */
+            mutable std::vector<std::pair<unsigned, unsigned>> pairs;
+            mutable std::unordered_map<unsigned long long, unsigned> pairIndex;
+
+            /**
+             * Adds or removes the endpoints of the particles that start
+             * or stop colliding
+             */
+            void track() const;
+
+            /**
+             * Refreshes the endpoints of an axis from the store and
+             * restores their order with an insertion sort
+             */
+            void sortAxis(unsigned axis) const;
+
+            /**
+             * Checks if the boxes of the given particles overlap
+             * on all sorted axes except the given one.
+             */
+            bool overlapsOthers(unsigned i, unsigned j, unsigned axis) const;
+
+            void addPair(unsigned i, unsigned j) const;
+            void removePair(unsigned i, unsigned j) const;
+
+            static inline unsigned long long key(unsigned i, unsigned j){
+                if(i > j) std::swap(i, j);
+                return ((unsigned long long)i << 32) | j;
+            };
+        };
+    }
+}
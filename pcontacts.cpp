@@ -4,16 +4,70 @@
  */
 
 #include "pcontacts.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
 using Gorgon::Geometry::Point3D;
 using namespace Gorgon::Physics;
 
-void ParticleContact::Resolve(unsigned long time)
+namespace
+{
+    /**
+     * Adds the given value to the slot of a recording array of the
+     * store, such as ParticleStore::pushOut, if the store is recording
+     */
+    void record(std::vector<real> *arr, unsigned index, const Point3D &value)
+    {
+        if(index >= arr[0].size()) return;
+
+        real values[ParticleStore::Axes];
+        ParticleStore::ToArray(value, values);
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+            arr[a][index] += values[a];
+    }
+
+    /**
+     * Returns how far the contacts moved the particle so far in this
+     * step, zero if its store isn't recording
+     */
+    Point3D recordedMove(const Particle *particle)
+    {
+        if(particle == nullptr) return Point3D(0, 0, 0);
+
+        const ParticleStore &store = particle->GetStore();
+        unsigned index = particle->GetIndex();
+        if(index >= store.pushOut[0].size()) return Point3D(0, 0, 0);
+
+        real values[ParticleStore::Axes];
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+            values[a] = store.pushOut[a][index] + store.linkMove[a][index];
+        return ParticleStore::ToPoint(values);
+    }
+
+    /**
+     * Records the velocity changes of a link
+     */
+    void recordLink(const ParticleContact &contact, const Point3D &impulsePerMass)
+    {
+        for(unsigned k = 0; k < 2; k++)
+        {
+            Particle *particle = contact.particle[k];
+            if(particle == nullptr) continue;
+
+            real share = k == 0 ? particle->GetInverseMass() : -particle->GetInverseMass();
+            record(particle->GetStore().linkVelocity, particle->GetIndex(), impulsePerMass * share);
+        }
+    }
+}
+
+void ParticleContact::Resolve(double time)
 {
     ResolveVelocity(time);
     ResolveInterPenetration(time);
 }
 
-double ParticleContact::CalcSepVel() const
+real ParticleContact::CalcSepVel() const
 {
     /**
      * We can calculate the seperating velocity using the
@@ -29,7 +83,7 @@ double ParticleContact::CalcSepVel() const
     return (relativeVelocity * ContactNormal);
 }
 
-void ParticleContact::ResolveVelocity(unsigned long time)
+void ParticleContact::ResolveVelocity(double time)
 {
 
     /**
@@ -53,7 +107,7 @@ void ParticleContact::ResolveVelocity(unsigned long time)
 
 
     // Get the seperating velocity before collision
-    double sepVel = CalcSepVel();
+    real sepVel = CalcSepVel();
 
     /**
      * If the seperating velocity greater than zero it
@@ -68,14 +122,14 @@ void ParticleContact::ResolveVelocity(unsigned long time)
      * Calculate the seperating velocity after collision
      * using the formula Vs (After) = Vs (before) * restitution
      */
-    double newSepVel = -sepVel * restitution;
+    real newSepVel = -sepVel * restitution;
 
             // Check the velocity build-up due to acceleration only.
             Point3D accCausedVelocity = particle[0]->GetAcceleration();
             if(particle[1] != nullptr)
                 accCausedVelocity = accCausedVelocity - particle[1]->GetAcceleration();
 
-            double accCausedSepVelocity = accCausedVelocity * ContactNormal * time;
+            real accCausedSepVelocity = accCausedVelocity * ContactNormal * real(time);
 
             // If we've got a closing velocity due to acceleration build-up,
             // remove it from the new separating velocity
@@ -94,7 +148,7 @@ void ParticleContact::ResolveVelocity(unsigned long time)
      * The new relative velocity is the delta velocity (pre and post collision)
      * */ 
 
-    double deltaVelocity = newSepVel - sepVel;
+    real deltaVelocity = newSepVel - sepVel;
 
     /**
      * We apply the change in velocity to each object
@@ -102,7 +156,7 @@ void ParticleContact::ResolveVelocity(unsigned long time)
      * (less inverse mass = higher actual mass, which get less change in velocity)
      */
 
-    double totalInverseMass = particle[0]->GetInverseMass();
+    real totalInverseMass = particle[0]->GetInverseMass();
     if(particle[1] != nullptr)
         totalInverseMass += particle[1]->GetInverseMass();
     
@@ -110,7 +164,7 @@ void ParticleContact::ResolveVelocity(unsigned long time)
     if(totalInverseMass <= 0) return;
 
     // The magintude of the impulse
-    double impulse = deltaVelocity / totalInverseMass;
+    real impulse = deltaVelocity / totalInverseMass;
  
     /*
      * Find the amount of impulse per unit of inverse mass.
@@ -137,31 +191,240 @@ void ParticleContact::ResolveVelocity(unsigned long time)
         // hence the nigative sign to the inverse mass
         particle[1]->SetVelocity(particle[1]->GetVelocity() + impulsePerMass * -particle[1]->GetInverseMass());
     }
+
+    if(link)
+        recordLink(*this, impulsePerMass);
+
+    accumulatedImpulse += impulse;
 }
 
-void ParticleContact::ResolveInterPenetration(unsigned long time)
+void ParticleContact::ResolveInterPenetration(double time)
 {
     // If there's no penetration, exit;
     if (penetration <= 0) return;
 
     // The movement of the objects are in propertion with their mass    
-    double totalInverseMass = particle[0]->GetInverseMass();
+    real totalInverseMass = particle[0]->GetInverseMass();
     if(particle[1] != nullptr) 
         totalInverseMass += particle[1]->GetInverseMass();
 
     // If the objects that are colliding have infinite masses, we do nothing
     if(totalInverseMass <= 0) return;
 
+    // While the store records the moves, the ones of the contacts that
+    // are already resolved are taken off, so a particle shared by two
+    // contacts isn't moved twice for the same penetration
+    real depth = penetration - (recordedMove(particle[0]) - recordedMove(particle[1])) * ContactNormal;
+    if(depth <= 0)
+    {
+        penetration = 0;
+        return;
+    }
+
     // Find the amount of penetration per unit of inverse mass
-    Point3D movePerIMass = ContactNormal * (-penetration / totalInverseMass);
+    Point3D movePerIMass = ContactNormal * (depth / totalInverseMass);
 
-    // Apply the penetration
-    particle[0]->SetPosition(particle[0]->GetPosition() + movePerIMass * particle[0]->GetInverseMass());
-    if(particle[1] != nullptr)
-        particle[1]->SetPosition(particle[1]->GetPosition() + movePerIMass * particle[1]->GetInverseMass());
+    // Apply the penetration, the first particle moves along the
+    // contact normal and the second one in the opposite direction
+    for(unsigned k = 0; k < 2; k++)
+    {
+        if(particle[k] == nullptr) continue;
+
+        Point3D move = movePerIMass * (k == 0 ? particle[k]->GetInverseMass() : -particle[k]->GetInverseMass());
+        particle[k]->SetPosition(particle[k]->GetPosition() + move);
+
+        // links are constraints, their moves are not a push-out
+        ParticleStore &store = particle[k]->GetStore();
+        record(link ? store.linkMove : store.pushOut, particle[k]->GetIndex(), move);
+    }
+
+    // The penetration of this contact is resolved
+    penetration = 0;
+
+}
+
+
+namespace
+{
+    /**
+     * Applies an impulse along the normal of the contact
+     */
+    void applyImpulse(ParticleContact &contact, real impulse)
+    {
+        Point3D impulsePerMass = contact.ContactNormal * impulse;
+
+        Particle *first = contact.particle[0], *second = contact.particle[1];
+        first->SetVelocity(first->GetVelocity() + impulsePerMass * first->GetInverseMass());
+        if(second != nullptr)
+            second->SetVelocity(second->GetVelocity() + impulsePerMass * -second->GetInverseMass());
+
+        if(contact.link)
+            recordLink(contact, impulsePerMass);
+
+        contact.accumulatedImpulse += impulse;
+    }
+
+    real totalInverseMass(const ParticleContact &contact)
+    {
+        real total = contact.particle[0]->GetInverseMass();
+        if(contact.particle[1] != nullptr)
+            total += contact.particle[1]->GetInverseMass();
+        return total;
+    }
+}
 
+ParticleContactCache::Key ParticleContactCache::key(const ParticleContact &contact)
+{
+    Key key{contact.particle[0], contact.particle[1], contact.feature};
+    if(key.second != nullptr && key.second < key.first)
+        std::swap(key.first, key.second);
+    return key;
 }
 
+void ParticleContactCache::WarmStart(ParticleContact *contacts, unsigned count)
+{
+    if(impulses.empty()) return;
+
+    // apply all cached impulses first, a contact in a stack
+    // carries the weight of the ones above it
+    for(unsigned i = 0; i < count; i++)
+    {
+        ParticleContact &contact = contacts[i];
+
+        auto it = impulses.find(key(contact));
+        if(it == impulses.end() || totalInverseMass(contact) <= 0) continue;
+
+        applyImpulse(contact, it->second * factor);
+    }
+
+    // then take back what makes the contacts separate. Taking back from
+    // one contact changes its neighbours, so the contacts are swept a few
+    // times in alternating order.
+    for(unsigned pass = 0; pass < TakeBackPasses; pass++)
+    {
+        bool changed = false;
+        for(unsigned n = 0; n < count; n++)
+        {
+            ParticleContact &contact = contacts[pass % 2 ? count - 1 - n : n];
+            if(contact.accumulatedImpulse <= 0) continue;
+
+            real sepVel = contact.CalcSepVel();
+            if(sepVel <= 0) continue;
+
+            real excess = std::min(contact.accumulatedImpulse, sepVel / totalInverseMass(contact));
+            applyImpulse(contact, -excess);
+            changed = true;
+        }
+
+        if(!changed) break;
+    }
+}
+
+void ParticleContactCache::Store(const ParticleContact *contacts, unsigned count)
+{
+    next.clear();
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(contacts[i].accumulatedImpulse <= 0) continue;
+
+        // generators that don't set the features may give
+        // the same key to more than one contact
+        real &impulse = next[key(contacts[i])];
+        impulse = std::max(impulse, contacts[i].accumulatedImpulse);
+    }
+
+    std::swap(impulses, next);
+}
+
+void ParticleContactCache::Clear()
+{
+    impulses.clear();
+    next.clear();
+}
+
+void ParticleContactCache::Set(const Particle *first, const Particle *second, unsigned feature, real impulse)
+{
+    Key key{first, second, feature};
+    if(key.second != nullptr && key.second < key.first)
+        std::swap(key.first, key.second);
+    impulses[key] = impulse;
+}
+
+ParticleContactArena::ParticleContactArena(unsigned capacity, unsigned maxCapacity)
+: contacts(capacity ? capacity : 1), maxCapacity(maxCapacity)
+{
+}
+
+void ParticleContactArena::Commit(unsigned count)
+{
+    used += count;
+    if(used > highWater)
+        highWater = used;
+}
+
+bool ParticleContactArena::Grow()
+{
+    unsigned capacity = GetCapacity() * 2;
+    if(maxCapacity && capacity > maxCapacity)
+        capacity = maxCapacity;
+
+    if(capacity <= GetCapacity()) return false;
+
+    contacts.resize(capacity);
+    grows++;
+
+    return true;
+}
+
+unsigned ParticleContactArena::Generate(const ParticleContactGenerator &gen)
+{
+    while(true)
+    {
+        if(GetRemaining() == 0 && !Grow())
+        {
+            ReportOverflow();
+            return 0;
+        }
+
+        unsigned limit = GetRemaining();
+        unsigned count = gen.AddContact(Next(), limit);
+
+        if(count < limit)
+        {
+            Commit(count);
+            return count;
+        }
+
+        // the generator filled the arena and may have more
+        // contacts, run it again with more room
+        if(!Grow())
+        {
+            Commit(count);
+            ReportOverflow();
+            return count;
+        }
+    }
+}
+
+void ParticleContactArena::Append(ParticleContactArena &other)
+{
+    unsigned count = other.GetUsed();
+    while(GetRemaining() < count && Grow())
+        ;
+
+    if(GetRemaining() < count)
+    {
+        count = GetRemaining();
+        ReportOverflow();
+    }
+
+    std::copy(other.GetContacts(), other.GetContacts() + count, Next());
+    Commit(count);
+}
+
+const unsigned ParticleContactResolver::NoContact;
+const unsigned ParticleContactResolver::MaxColors;
+const unsigned ParticleContactCache::TakeBackPasses;
 
 ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 : iterations(iterations)  {};
@@ -173,19 +436,38 @@ ParticleContactResolver::ParticleContactResolver(unsigned iterations)
 
 void ParticleContactResolver::ResolveContacts(ParticleContact *contactArr, unsigned numOfContacts, double time)
 {
-    unsigned i;
     iterationsUsed = 0;
 
+    // the slop is left in, so resting contacts keep touching
+    if(penetrationSlop > 0)
+    {
+        for(unsigned i = 0; i < numOfContacts; i++)
+            if(!contactArr[i].link)
+                contactArr[i].penetration -= penetrationSlop;
+    }
+
+    if(mode == Mode::Heap)
+        resolveHeap(contactArr, numOfContacts, time);
+    else if(mode == Mode::Parallel)
+        resolveParallel(contactArr, numOfContacts, time);
+    else
+        resolveLinear(contactArr, numOfContacts, time);
+}
+
+void ParticleContactResolver::resolveLinear(ParticleContact *contactArr, unsigned numOfContacts, double time)
+{
+    unsigned i;
+
     while (iterationsUsed < iterations)
     {
         //Find the contact with the largest closing velocity
-        double max = std::numeric_limits<double>::max();
+        real max = std::numeric_limits<real>::max();
 
         unsigned maxIndex = numOfContacts;
 
         for (i = 0; i < numOfContacts; i++)
         {
-            double sepVel = contactArr[i].CalcSepVel();
+            real sepVel = contactKey(contactArr[i]);
 
             if(sepVel < max)
             {
@@ -204,3 +486,260 @@ void ParticleContactResolver::ResolveContacts(ParticleContact *contactArr, unsig
     }
     
 }
+
+real ParticleContactResolver::contactKey(const ParticleContact &contact)
+{
+    real sepVel = contact.CalcSepVel();
+
+    if(sepVel < 0 || contact.penetration > 0)
+        return sepVel;
+
+    return std::numeric_limits<real>::max();
+}
+
+void ParticleContactResolver::buildAdjacency(ParticleContact *contactArr, unsigned numOfContacts)
+{
+    // list each contact under each of its particles, then group by particle
+    entries.clear();
+    for(unsigned i = 0; i < numOfContacts; i++)
+    {
+        for(unsigned k = 0; k < 2; k++)
+        {
+            const Particle *particle = contactArr[i].particle[k];
+            if(particle != nullptr)
+                entries.push_back({&particle->GetStore(), particle->GetIndex(), 2 * i + k});
+        }
+    }
+
+    auto same = [](const Entry &l, const Entry &r){
+        return l.store == r.store && l.index == r.index;
+    };
+
+    std::sort(entries.begin(), entries.end(),
+        [](const Entry &l, const Entry &r){
+            if(l.store != r.store)
+                return std::less<const ParticleStore*>()(l.store, r.store);
+            if(l.index != r.index)
+                return l.index < r.index;
+            return l.contact < r.contact;
+        }
+    );
+
+    adjacency.clear();
+    contactAdjacency.assign(2 * numOfContacts, NoContact);
+
+    for(unsigned k = 0; k < entries.size(); k++)
+    {
+        if(k == 0 || !same(entries[k], entries[k - 1]))
+        {
+            if(k != 0) adjacency.push_back(NoContact);
+            contactAdjacency[entries[k].contact] = (unsigned)adjacency.size();
+        }
+        else
+        {
+            contactAdjacency[entries[k].contact] = contactAdjacency[entries[k - 1].contact];
+        }
+
+        adjacency.push_back(entries[k].contact / 2);
+    }
+    adjacency.push_back(NoContact);
+}
+
+void ParticleContactResolver::resolveHeap(ParticleContact *contactArr, unsigned numOfContacts, double time)
+{
+    if(numOfContacts == 0) return;
+
+    buildAdjacency(contactArr, numOfContacts);
+
+    heap.resize(numOfContacts);
+    heapPos.resize(numOfContacts);
+    heapKey.resize(numOfContacts);
+
+    for(unsigned i = 0; i < numOfContacts; i++)
+    {
+        heap[i] = i;
+        heapPos[i] = i;
+        heapKey[i] = contactKey(contactArr[i]);
+    }
+    for(unsigned i = numOfContacts / 2; i-- > 0;)
+        siftDown(i);
+
+    while (iterationsUsed < iterations)
+    {
+        // The top of the heap has the largest closing velocity
+        unsigned top = heap[0];
+
+        // Do we have anything worth resolving?
+        if(heapKey[top] == std::numeric_limits<real>::max()) break;
+
+        contactArr[top].Resolve(time);
+
+        // Only the contacts that share a particle
+        // with the resolved one have changed
+        for(unsigned k = 0; k < 2; k++)
+        {
+            unsigned start = contactAdjacency[2 * top + k];
+            if(start == NoContact) continue;
+
+            for(unsigned a = start; adjacency[a] != NoContact; a++)
+                heapUpdate(adjacency[a], contactKey(contactArr[adjacency[a]]));
+        }
+
+        iterationsUsed++;
+    }
+}
+
+void ParticleContactResolver::heapUpdate(unsigned contact, real key)
+{
+    real old = heapKey[contact];
+    heapKey[contact] = key;
+
+    if(key < old)
+        siftUp(heapPos[contact]);
+    else if(key > old)
+        siftDown(heapPos[contact]);
+}
+
+void ParticleContactResolver::siftUp(unsigned pos)
+{
+    unsigned contact = heap[pos];
+
+    while(pos > 0)
+    {
+        unsigned parent = (pos - 1) / 2;
+        if(!heapLess(contact, heap[parent])) break;
+
+        heap[pos] = heap[parent];
+        heapPos[heap[pos]] = pos;
+        pos = parent;
+    }
+
+    heap[pos] = contact;
+    heapPos[contact] = pos;
+}
+
+void ParticleContactResolver::siftDown(unsigned pos)
+{
+    unsigned contact = heap[pos];
+    unsigned size = (unsigned)heap.size();
+
+    while(true)
+    {
+        unsigned child = 2 * pos + 1;
+        if(child >= size) break;
+
+        if(child + 1 < size && heapLess(heap[child + 1], heap[child]))
+            child++;
+
+        if(!heapLess(heap[child], contact)) break;
+
+        heap[pos] = heap[child];
+        heapPos[heap[pos]] = pos;
+        pos = child;
+    }
+
+    heap[pos] = contact;
+    heapPos[contact] = pos;
+}
+
+void ParticleContactResolver::buildColors(ParticleContact */*contactArr*/, unsigned numOfContacts)
+{
+    // colors used by each particle, indexed by where
+    // the group of the particle starts in the adjacency
+    std::vector<unsigned long long> &used = colorMasks;
+    used.assign(adjacency.size(), 0);
+
+    colorOf.resize(numOfContacts);
+    colorStart.assign(MaxColors + 2, 0);
+
+    // greedy coloring in contact order, so it doesn't depend
+    // on the number of threads
+    for(unsigned i = 0; i < numOfContacts; i++)
+    {
+        unsigned long long taken = 0;
+        for(unsigned k = 0; k < 2; k++)
+        {
+            unsigned group = contactAdjacency[2 * i + k];
+            if(group != NoContact) taken |= used[group];
+        }
+
+        unsigned color = 0;
+        while(color < MaxColors && (taken & (1ULL << color)))
+            color++;
+
+        if(color < MaxColors)
+        {
+            for(unsigned k = 0; k < 2; k++)
+            {
+                unsigned group = contactAdjacency[2 * i + k];
+                if(group != NoContact) used[group] |= 1ULL << color;
+            }
+        }
+
+        colorOf[i] = color;
+        colorStart[color + 1]++;
+    }
+
+    for(unsigned c = 1; c < colorStart.size(); c++)
+        colorStart[c] += colorStart[c - 1];
+
+    // sort by color, keeping the contact order within a color
+    colored.resize(numOfContacts);
+    for(unsigned i = 0; i < numOfContacts; i++)
+        colored[colorStart[colorOf[i]]++] = i;
+
+    // placing the contacts moved each start to the start of the next color
+    for(unsigned c = (unsigned)colorStart.size() - 1; c > 0; c--)
+        colorStart[c] = colorStart[c - 1];
+    colorStart[0] = 0;
+}
+
+void ParticleContactResolver::resolveParallel(ParticleContact *contactArr, unsigned numOfContacts, double time)
+{
+    if(numOfContacts == 0) return;
+
+    buildAdjacency(contactArr, numOfContacts);
+    buildColors(contactArr, numOfContacts);
+
+    unsigned threads = pool ? pool->GetThreadCount() : 1;
+
+    // sweep over the colors until nothing is left to resolve
+    // or the iterations run out
+    while (iterationsUsed < iterations)
+    {
+        unsigned sweepResolved = 0;
+
+        for(unsigned c = 0; c <= MaxColors && iterationsUsed < iterations; c++)
+        {
+            unsigned begin = colorStart[c], end = colorStart[c + 1];
+            if(begin == end) continue;
+
+            // the contacts of a color share no particle, except
+            // for the last one which isn't colored
+            auto batch = [&](unsigned from, unsigned to, unsigned worker){
+                unsigned count = 0;
+                for(unsigned k = from; k < to; k++)
+                {
+                    ParticleContact &contact = contactArr[colored[begin + k]];
+                    if(contactKey(contact) == std::numeric_limits<real>::max()) continue;
+
+                    contact.Resolve(time);
+                    count++;
+                }
+                resolved[worker] = count;
+            };
+
+            resolved.assign(threads, 0);
+            if(pool && c < MaxColors)
+                pool->Run(end - begin, batch);
+            else
+                batch(0, end - begin, 0);
+
+            unsigned count = std::accumulate(resolved.begin(), resolved.end(), 0u);
+            sweepResolved += count;
+            iterationsUsed += count;
+        }
+
+        if(sweepResolved == 0) break;
+    }
+}
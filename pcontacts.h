@@ -6,8 +6,12 @@
 #pragma once
 
 #include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <Gorgon/Physics/particle.h>
+#include <Gorgon/Physics/pjobs.h>
 #include <Gorgon/Geometry/Point3D.h>
 namespace Gorgon {
     namespace Physics
@@ -16,6 +20,7 @@ namespace Gorgon {
         {
 
         friend class ParticleContactResolver;
+        friend class ParticleContactCache;
 
         public:
             // Hold the two colliding/contacting particles
@@ -24,35 +29,173 @@ namespace Gorgon {
             Particle *particle[2];
 
             // Holds the normal restitution coefficient at the contact.
-            double restitution;
+            real restitution;
 
             // Holds the direction of the contact
             Gorgon::Geometry::Point3D ContactNormal;
 
             // Holds the depth of the penetration
-            double penetration;
+            real penetration;
+
+            // Identifies the surface of a contact with the scenery, so
+            // the contacts of a particle with two surfaces of the same
+            // generator can be told apart across frames. Zero by default.
+            unsigned feature = 0;
+
+            // Marks the contacts of rods and cables. The penetration slop
+            // of the resolver isn't applied to them, so they keep their
+            // length. False by default.
+            bool link = false;
+
+            // Holds the total impulse applied along the normal in this
+            // frame, including the one from warm starting
+            real accumulatedImpulse = 0;
 
         protected:
             // A central function resolve contacts and interpenetration
-            void Resolve(unsigned long time);
+            void Resolve(double time);
 
             // Calculate the seperating velocity at this contact
-            double CalcSepVel() const;
+            real CalcSepVel() const;
 
         private:
             // Calculates the impulse for this contact
-            void ResolveVelocity(unsigned long time);
+            void ResolveVelocity(double time);
 
-            void ResolveInterPenetration(unsigned long time);
+            void ResolveInterPenetration(double time);
         };
         class ParticleContactResolver
         {
+        public:
+            /**
+             * How the resolver finds the contact to resolve next
+             */
+            enum class Mode
+            {
+                /// Scans all contacts at each iteration
+                Linear,
+
+                /// Keeps the contacts in an indexed heap, only the
+                /// contacts that share a particle with the resolved
+                /// contact are updated at each iteration
+                Heap,
+
+                /// Colors the contacts so that the contacts of a color
+                /// share no particle. The colors are resolved one after
+                /// the other, the contacts of a color in parallel. The
+                /// iteration limit is checked between the colors.
+                Parallel
+            };
+
         protected:
             // Holds the number of iterations allowed.
             unsigned iterations;
 
             // A value to keep track with the actual number of iterations used
-            unsigned iterationsUsed;
+            unsigned iterationsUsed = 0;
+
+            /**
+             * Holds the penetration that's left unresolved
+             */
+            real penetrationSlop = 0;
+
+            Mode mode = Mode::Linear;
+
+            /**
+             * The particle to contacts adjacency. Holds the index of
+             * each contact once for each of its particles, grouped by
+             * particle. adjacency[contactAdjacency[2*i+k]] is where the
+             * group of the k-th particle of contact i starts, and each
+             * group ends with NoContact. Particles are grouped by their
+             * slots, since two contacts can name the same slot through
+             * different particle objects.
+             */
+            std::vector<unsigned> adjacency;
+            std::vector<unsigned> contactAdjacency;
+
+            struct Entry
+            {
+                const ParticleStore *store;
+                unsigned index;
+                unsigned contact;
+            };
+            std::vector<Entry> entries;
+
+            /**
+             * Indexed heap of contacts ordered by their keys, heapPos
+             * holds the position of each contact in the heap.
+             */
+            std::vector<unsigned> heap;
+            std::vector<unsigned> heapPos;
+            std::vector<real> heapKey;
+
+            /**
+             * The contacts sorted by their colors, colorStart holds where
+             * each color starts. The last color holds the contacts that
+             * couldn't be colored; they are resolved serially.
+             */
+            std::vector<unsigned> colored;
+            std::vector<unsigned> colorStart;
+            std::vector<unsigned> colorOf;
+            std::vector<unsigned long long> colorMasks;
+
+            /**
+             * Number of contacts each worker resolved in the last batch
+             */
+            std::vector<unsigned> resolved;
+
+            /**
+             * Runs the colors in parallel, can be null
+             */
+            ThreadPool *pool = nullptr;
+
+            static const unsigned NoContact = (unsigned)-1;
+
+            /**
+             * Number of colors a particle can take part in. Contacts that
+             * don't fit are moved to the serial batch.
+             */
+            static const unsigned MaxColors = 64;
+
+            /**
+             * Resolves the contacts by scanning for the contact with the
+             * largest closing velocity at each iteration.
+             */
+            void resolveLinear(ParticleContact *contactArr, unsigned numOfContacts, double time);
+
+            /**
+             * Resolves the contacts using the indexed heap
+             */
+            void resolveHeap(ParticleContact *contactArr, unsigned numOfContacts, double time);
+
+            /**
+             * Resolves the contacts color by color
+             */
+            void resolveParallel(ParticleContact *contactArr, unsigned numOfContacts, double time);
+
+            /**
+             * Colors the contacts, requires the adjacency
+             */
+            void buildColors(ParticleContact *contactArr, unsigned numOfContacts);
+
+            /**
+             * Builds the particle to contacts adjacency
+             */
+            void buildAdjacency(ParticleContact *contactArr, unsigned numOfContacts);
+
+            /**
+             * Returns the key of a contact in the heap. Contacts that
+             * neither close nor penetrate don't need resolution and get
+             * the largest key.
+             */
+            static real contactKey(const ParticleContact &contact);
+
+            void heapUpdate(unsigned contact, real key);
+            void siftUp(unsigned pos);
+            void siftDown(unsigned pos);
+            inline bool heapLess(unsigned a, unsigned b) const{
+                return heapKey[a] < heapKey[b] || (heapKey[a] == heapKey[b] && a < b);
+            }
 
         public:
             // Creates a new contact resolver
@@ -62,6 +205,44 @@ namespace Gorgon {
                 this->iterations = iterations;
             }
 
+            inline unsigned GetIterations() const{
+                return iterations;
+            }
+
+            /**
+             * Sets how deep the contacts may stay in each other. Resting
+             * contacts that are resolved completely end up just touching
+             * and flicker in and out of existence; a small slop keeps
+             * them touching, which warm starting needs. The contacts of
+             * links are resolved completely.
+             */
+            inline void SetPenetrationSlop(real value){
+                penetrationSlop = value;
+            }
+            inline real GetPenetrationSlop() const{
+                return penetrationSlop;
+            }
+
+            inline unsigned GetIterationsUsed() const{
+                return iterationsUsed;
+            }
+
+            inline void SetMode(Mode mode){
+                this->mode = mode;
+            }
+            inline Mode GetMode() const{
+                return mode;
+            }
+
+            /**
+             * Sets the thread pool that runs the parallel mode. The pool
+             * is not owned by the resolver. Without a pool the parallel
+             * mode runs on the calling thread.
+             */
+            inline void SetThreadPool(ThreadPool *pool){
+                this->pool = pool;
+            }
+
             /**
              *
              * @param contactsArr array of particle contact objects (i.e. objects that are contacting)
@@ -70,6 +251,238 @@ namespace Gorgon {
              */
             void ResolveContacts(ParticleContact *contactArr, unsigned numOfContacts, double time);
         };
+        /**
+         * Keeps the impulses of the contacts across frames to warm start
+         * the resolver. The contacts are keyed by their particle pair,
+         * or by the particle and the feature for contacts with the
+         * scenery. At the start of a frame each contact that existed in
+         * the last frame gets its impulse applied again, so resting
+         * stacks and taut links start close to their solution and the
+         * resolver needs few iterations.
+         */
+        class ParticleContactCache
+        {
+        public:
+            /**
+             * Fraction of the last frame's impulse that's applied
+             */
+            real factor = 1;
+
+            /**
+             * Maximum number of sweeps that take back the impulses
+             * that make the contacts separate
+             */
+            static const unsigned TakeBackPasses = 4;
+
+            /**
+             * Applies the cached impulses to the given contacts. An
+             * impulse that makes its contact separate is taken back
+             * as far as needed, so warm starting never pushes the
+             * particles apart.
+             */
+            void WarmStart(ParticleContact *contacts, unsigned count);
+
+            /**
+             * Keeps the impulses of the given resolved contacts for the
+             * next frame, the contacts that are gone are forgotten.
+             */
+            void Store(const ParticleContact *contacts, unsigned count);
+
+            void Clear();
+
+            inline unsigned GetCount() const{
+                return (unsigned)impulses.size();
+            };
+
+            /**
+             * Calls the given function with the particles, the feature
+             * and the impulse of each cached contact
+             */
+            template<class F_>
+            void ForEach(F_ fn) const{
+                for(auto &entry : impulses)
+                    fn(entry.first.first, entry.first.second, entry.first.feature, entry.second);
+            }
+
+            /**
+             * Adds a contact impulse to the cache
+             */
+            void Set(const Particle *first, const Particle *second, unsigned feature, real impulse);
+
+            /**
+             * Forgets the contacts for which the given function returns
+             * true when it's called with their particles
+             */
+            template<class F_>
+            void RemoveIf(F_ fn){
+                for(auto it = impulses.begin(); it != impulses.end();)
+                {
+                    if(fn(it->first.first, it->first.second))
+                        it = impulses.erase(it);
+                    else
+                        ++it;
+                }
+            }
+
+        protected:
+            struct Key
+            {
+                const Particle *first;
+                const Particle *second;
+                unsigned feature;
+
+                bool operator==(const Key &other) const{
+                    return first == other.first && second == other.second && feature == other.feature;
+                }
+            };
+
+            struct KeyHash
+            {
+                size_t operator()(const Key &key) const{
+                    size_t h = std::hash<const void*>()(key.first);
+                    h ^= std::hash<const void*>()(key.second) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                    h ^= std::hash<unsigned>()(key.feature) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                    return h;
+                }
+            };
+
+            /**
+             * Returns the key of the contact; the particles of a pair
+             * are ordered so the key doesn't depend on their order
+             */
+            static Key key(const ParticleContact &contact);
+
+            std::unordered_map<Key, real, KeyHash> impulses, next;
+        };
+
+        /**
+         * Holds the contacts of a frame. The arena starts with the given
+         * capacity and doubles it when the generators need more room,
+         * up to an optional maximum. The memory is kept across the
+         * frames, so once the arena is large enough for the scene no
+         * more allocations happen. The arena keeps statistics to tune
+         * the initial capacity.
+         */
+        class ParticleContactGenerator;
+
+        class ParticleContactArena
+        {
+        public:
+            /**
+             * Creates an arena with the given capacity. A zero maximum
+             * capacity lets the arena grow without a limit.
+             */
+            ParticleContactArena(unsigned capacity, unsigned maxCapacity = 0);
+
+            /**
+             * Empties the arena for a new frame, keeping its memory
+             */
+            inline void Reset(){
+                // generators don't have to fill these
+                for(unsigned i = 0; i < used; i++)
+                {
+                    contacts[i].feature = 0;
+                    contacts[i].link = false;
+                    contacts[i].penetration = 0;
+                    contacts[i].accumulatedImpulse = 0;
+                }
+                used = 0;
+            };
+
+            /**
+             * Returns the first free contact
+             */
+            inline ParticleContact *Next(){
+                return contacts.data() + used;
+            };
+
+            /**
+             * Returns the number of free contacts
+             */
+            inline unsigned GetRemaining() const{
+                return (unsigned)contacts.size() - used;
+            };
+
+            /**
+             * Marks the given number of free contacts as used
+             */
+            void Commit(unsigned count);
+
+            /**
+             * Doubles the capacity, limited by the maximum capacity.
+             * Returns false if the arena can't grow any more. The used
+             * contacts are kept, but pointers to them are invalidated.
+             */
+            bool Grow();
+
+            /**
+             * Runs the given generator, writing its contacts after the
+             * used ones and growing the arena if the generator fills it.
+             * Returns the number of contacts written.
+             */
+            unsigned Generate(const ParticleContactGenerator &gen);
+
+            /**
+             * Copies the used contacts of the given arena after the
+             * used contacts of this one, growing if needed.
+             */
+            void Append(ParticleContactArena &other);
+
+            /**
+             * Records that contacts are dropped because the arena
+             * is at its maximum capacity
+             */
+            inline void ReportOverflow(){
+                overflows++;
+            };
+
+            inline ParticleContact *GetContacts(){
+                return contacts.data();
+            };
+            inline unsigned GetUsed() const{
+                return used;
+            };
+            inline unsigned GetCapacity() const{
+                return (unsigned)contacts.size();
+            };
+            inline void SetMaxCapacity(unsigned value){
+                maxCapacity = value;
+            };
+            inline unsigned GetMaxCapacity() const{
+                return maxCapacity;
+            };
+
+            /**
+             * Returns the largest number of contacts used in a frame
+             */
+            inline unsigned GetHighWaterMark() const{
+                return highWater;
+            };
+
+            /**
+             * Returns the number of times the arena grew
+             */
+            inline unsigned GetGrowCount() const{
+                return grows;
+            };
+
+            /**
+             * Returns the number of times contacts are dropped
+             */
+            inline unsigned GetOverflowCount() const{
+                return overflows;
+            };
+
+        protected:
+            std::vector<ParticleContact> contacts;
+            unsigned used = 0;
+            unsigned maxCapacity;
+
+            unsigned highWater = 0;
+            unsigned grows = 0;
+            unsigned overflows = 0;
+        };
+
         /**
          * This is the basic interface for contact generators
          * applying to particles.
@@ -87,6 +500,26 @@ namespace Gorgon {
              * been written.
              */
             virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const = 0;
+
+            /**
+             * Fills the given array with the particles that this generator
+             * keeps connected, such as the two ends of a link, and returns
+             * their number. The world joins these particles into the same
+             * island, and skips the generator while they are all asleep.
+             * Generators that don't connect particles return zero.
+             */
+            virtual unsigned GetConnected(Particle *(&/*particles*/)[2]) const{
+                return 0;
+            }
+
+            /**
+             * Updates the particle indices that the generator keeps after
+             * the given store is compacted or particles are removed from
+             * it, see ParticleBatchForce::Remap. Generators that keep
+             * Particle pointers don't need it, particle objects are
+             * updated by the store.
+             */
+            virtual void Remap(const ParticleStore &/*store*/, const std::vector<unsigned> &/*remap*/){ }
         };
     };
 
@@ -0,0 +1,195 @@
+/**
+ * @file pemitter.cpp is the implementation for pemitter.h
+ */
+#include <Gorgon/Physics/pemitter.h>
+#include <algorithm>
+
+using Gorgon::Physics::ParticleEmitter;
+using Gorgon::Physics::WindField;
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::real;
+
+WindField::WindField(const Point3D &velocity, real coefficient)
+: velocity(velocity), coefficient(coefficient)
+{
+}
+
+void WindField::UpdateForces(ParticleStore &store, const unsigned *indices, unsigned count, double /*time*/)
+{
+    const unsigned Axes = ParticleStore::Axes;
+
+    real wind[Axes];
+    ParticleStore::ToArray(velocity, wind);
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        const real *v = store.velocity[a].data();
+        real *accum = store.forceAccum[a].data();
+
+        for(unsigned k = 0; k < count; k++)
+        {
+            unsigned i = indices[k];
+            accum[i] += (wind[a] - v[i]) * coefficient;
+        }
+    }
+}
+
+ParticleEmitter::ParticleEmitter(ParticleStore &store, unsigned capacity)
+: store(store)
+{
+    live.reserve(capacity);
+    lifetime.reserve(capacity);
+    free.reserve(capacity);
+
+    // the slots are taken in reverse so they are emitted in store order
+    std::vector<unsigned> slots(capacity);
+    for(unsigned k = 0; k < capacity; k++)
+    {
+        slots[k] = store.Create();
+        store.inverseMass[slots[k]] = 0;
+        store.transient[slots[k]] = 1;
+    }
+    free.assign(slots.rbegin(), slots.rend());
+}
+
+unsigned ParticleEmitter::Emit(unsigned count)
+{
+    const unsigned Axes = ParticleStore::Axes;
+
+    count = std::min(count, (unsigned)free.size());
+
+    real position[Axes], positionSpread[Axes];
+    real velocity[Axes], velocitySpread[Axes];
+    real acceleration[Axes];
+    ParticleStore::ToArray(settings.position, position);
+    ParticleStore::ToArray(settings.positionSpread, positionSpread);
+    ParticleStore::ToArray(settings.velocity, velocity);
+    ParticleStore::ToArray(settings.velocitySpread, velocitySpread);
+    ParticleStore::ToArray(settings.acceleration, acceleration);
+
+    real inverseMass = settings.mass > 0 ? 1 / settings.mass : 0;
+
+    for(unsigned k = 0; k < count; k++)
+    {
+        unsigned i = free.back();
+        free.pop_back();
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            store.position[a][i] = position[a] + positionSpread[a] * spread();
+            store.previous[a][i] = store.position[a][i];
+            store.velocity[a][i] = velocity[a] + velocitySpread[a] * spread();
+            store.acceleration[a][i] = acceleration[a];
+            store.forceAccum[a][i] = 0;
+        }
+        store.inverseMass[i] = inverseMass;
+        store.damping[i] = settings.damping;
+        store.asleep[i] = 0;
+
+        live.push_back(i);
+        lifetime.push_back(settings.lifetime + settings.lifetimeSpread * spread());
+    }
+
+    return count;
+}
+
+void ParticleEmitter::expire(unsigned index)
+{
+    store.inverseMass[index] = 0;
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        store.velocity[a][index] = 0;
+
+    free.push_back(index);
+}
+
+void ParticleEmitter::Clear()
+{
+    for(unsigned index : live)
+        expire(index);
+
+    live.clear();
+    lifetime.clear();
+}
+
+void ParticleEmitter::Release()
+{
+    Clear();
+
+    for(unsigned index : free)
+        store.Release(index);
+
+    free.clear();
+}
+
+void ParticleEmitter::AddField(ParticleField &field)
+{
+    fields.push_back(&field);
+}
+
+void ParticleEmitter::Update(double time)
+{
+    // the expired particles are dropped in one pass that keeps the
+    // rest in the order they were emitted
+    unsigned kept = 0;
+    for(unsigned k = 0; k < live.size(); k++)
+    {
+        real left = lifetime[k] - real(time);
+        if(left <= 0)
+        {
+            expire(live[k]);
+            continue;
+        }
+
+        live[kept] = live[k];
+        lifetime[kept] = left;
+        kept++;
+    }
+    live.resize(kept);
+    lifetime.resize(kept);
+
+    if(rate > 0)
+    {
+        pending += rate * time;
+        unsigned count = (unsigned)pending;
+        pending -= count;
+        Emit(count);
+    }
+}
+
+void ParticleEmitter::UpdateForces(double time)
+{
+    for(ParticleField *field : fields)
+        field->UpdateForces(store, live.data(), GetLiveCount(), time);
+}
+
+void ParticleEmitter::Remap(const ParticleStore &store, const std::vector<unsigned> &remap)
+{
+    if(&store != &this->store) return;
+
+    auto moved = [&remap](unsigned index){
+        return index < remap.size() ? remap[index] : ParticleStore::NoIndex;
+    };
+
+    unsigned kept = 0;
+    for(unsigned k = 0; k < live.size(); k++)
+    {
+        unsigned index = moved(live[k]);
+        if(index == ParticleStore::NoIndex) continue;
+
+        live[kept] = index;
+        lifetime[kept] = lifetime[k];
+        kept++;
+    }
+    live.resize(kept);
+    lifetime.resize(kept);
+
+    kept = 0;
+    for(unsigned k = 0; k < free.size(); k++)
+    {
+        unsigned index = moved(free[k]);
+        if(index == ParticleStore::NoIndex) continue;
+
+        free[kept++] = index;
+    }
+    free.resize(kept);
+}
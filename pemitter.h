@@ -0,0 +1,251 @@
+/**
+ * @file pemitter.h contains the ParticleEmitter class
+ *
+ * @brief An emitter spawns short lived particles such as sparks, debris
+ * and smoke. It takes a fixed number of slots from a store when it's
+ * created and hands them out as particles are emitted, so emitting and
+ * expiring particles doesn't allocate and doesn't touch the force
+ * registry. The emitted particles have no Particle objects: the emitter
+ * is a batch force that ages its particles and expires the ones whose
+ * lifetime is over once per step, and applies its force fields to the
+ * rest in a single pass whenever the forces are evaluated. Expired slots
+ * have zero inverse mass so the integrator skips them.
+ *
+ * Since they have no particle objects, emitted particles are not
+ * collided and don't fall asleep; their radius is always zero. The slots of an emitter are transient:
+ * restoring a snapshot of the world keeps their current state, so the
+ * emitted particles aren't rolled back and stay in step with the emitter.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pfgen.h>
+#include <Gorgon/Physics/pstore.h>
+#include <random>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        /**
+         * A force that an emitter applies to all of its live particles
+         */
+        class ParticleField
+        {
+        public:
+            virtual ~ParticleField(){ }
+
+            /**
+             * Adds the force of the field to the accumulators of the
+             * particles at the given indices of the store
+             */
+            virtual void UpdateForces(ParticleStore &store, const unsigned *indices, unsigned count, double time) = 0;
+        };
+
+        /**
+         * Pushes the particles towards the velocity of the wind in
+         * proportion to their relative velocity. Without wind it's a
+         * linear drag.
+         */
+        class WindField : public ParticleField
+        {
+        public:
+            WindField(const Point3D &velocity, real coefficient);
+
+            inline void SetVelocity(const Point3D &value){
+                velocity = value;
+            };
+            inline Point3D GetVelocity() const{
+                return velocity;
+            };
+
+            inline void SetCoefficient(real value){
+                coefficient = value;
+            };
+            inline real GetCoefficient() const{
+                return coefficient;
+            };
+
+            virtual void UpdateForces(ParticleStore &store, const unsigned *indices, unsigned count, double time) override;
+
+        private:
+            Point3D velocity;
+            real coefficient;
+        };
+
+        class ParticleEmitter : public ParticleBatchForce
+        {
+        public:
+            /**
+             * Describes the particles that are emitted. Each spread is
+             * the largest random offset from the value it belongs to;
+             * the vector ones are applied to each axis on its own.
+             */
+            struct Settings
+            {
+                Point3D position;
+                Point3D positionSpread;
+
+                Point3D velocity;
+                Point3D velocitySpread;
+
+                /**
+                 * Constant acceleration of the particles, such as gravity
+                 */
+                Point3D acceleration;
+
+                /**
+                 * Time the particles live in seconds
+                 */
+                real lifetime = 1;
+                real lifetimeSpread = 0;
+
+                real mass = 1;
+                real damping = 1;
+            };
+
+            /**
+             * Creates an emitter that can keep up to capacity particles
+             * alive in the given store. The slots are taken from the
+             * store right away.
+             */
+            ParticleEmitter(ParticleStore &store, unsigned capacity);
+
+            /**
+             * Emits up to the given number of particles and returns the
+             * number emitted. Particles are only emitted while there are
+             * free slots.
+             */
+            unsigned Emit(unsigned count);
+
+            /**
+             * Expires all live particles
+             */
+            void Clear();
+
+            /**
+             * Gives the slots back to the store. The emitter can't emit
+             * particles afterwards.
+             */
+            void Release();
+
+            /**
+             * Adds a field that's applied to the live particles. The
+             * field is not owned by the emitter.
+             */
+            void AddField(ParticleField &field);
+
+            /**
+             * Returns the settings of the particles that are emitted from
+             * now on
+             */
+            inline Settings &GetSettings(){
+                return settings;
+            };
+
+            /**
+             * Sets the number of particles emitted per second, spread
+             * over the frames. Zero stops the continuous emission.
+             */
+            inline void SetRate(real value){
+                rate = value;
+            };
+            inline real GetRate() const{
+                return rate;
+            };
+
+            /**
+             * Restarts the random numbers of the emitter from the given
+             * seed
+             */
+            inline void SetSeed(unsigned seed){
+                random.seed(seed);
+            };
+
+            inline unsigned GetLiveCount() const{
+                return (unsigned)live.size();
+            };
+
+            inline unsigned GetCapacity() const{
+                return (unsigned)(live.size() + free.size());
+            };
+
+            /**
+             * Returns the store indices of the live particles
+             */
+            inline const unsigned *GetLive() const{
+                return live.data();
+            };
+
+            /**
+             * Returns the time the live particle with the given order
+             * has left
+             */
+            inline real GetLifetime(unsigned particle) const{
+                return lifetime[particle];
+            };
+
+            inline ParticleStore &GetStore() const{
+                return store;
+            };
+
+            /**
+             * Ages the particles, expires the old ones and emits the new
+             * ones for the rate
+             */
+            virtual void Update(double time) override;
+
+            /**
+             * Applies the fields to the live particles
+             */
+            virtual void UpdateForces(double time) override;
+
+            /**
+             * Moves the slots of the emitter to their new indices, the
+             * released ones are dropped from the emitter
+             */
+            virtual void Remap(const ParticleStore &store, const std::vector<unsigned> &remap) override;
+
+        private:
+            /**
+             * Returns a random number between -1 and 1
+             */
+            inline real spread(){
+                return distribution(random);
+            };
+
+            /**
+             * Takes the particle at the given slot out of the simulation
+             */
+            void expire(unsigned index);
+
+            ParticleStore &store;
+            Settings settings;
+
+            /**
+             * Store indices of the live particles and the time they have
+             * left, in the order they are emitted
+             */
+            std::vector<unsigned> live;
+            std::vector<real> lifetime;
+
+            /**
+             * Store indices of the slots that can be emitted into
+             */
+            std::vector<unsigned> free;
+
+            std::vector<ParticleField*> fields;
+
+            real rate = 0;
+
+            /**
+             * Fraction of a particle left over from the continuous
+             * emission of the last frame
+             */
+            double pending = 0;
+
+            std::minstd_rand random;
+            std::uniform_real_distribution<real> distribution{-1, 1};
+        };
+    }
+}
@@ -5,6 +5,11 @@
 
 #include "./pfgen.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
 using Gorgon::Geometry::Point3D;
 using Gorgon::Physics::Particle;
 using Gorgon::Physics::ParticleForceGenerator;
@@ -13,27 +18,151 @@ using Gorgon::Physics::GravityGenerator;
 using Gorgon::Physics::SpringGenerator;
 using Gorgon::Physics::SpringAnchorGenerator;
 using Gorgon::Physics::BungeeGenerator;
+using Gorgon::Physics::ParticleBatchForce;
+using Gorgon::Physics::SpringNetwork;
+using Gorgon::Physics::ParticleIslands;
+using Gorgon::Physics::ParticleStore;
 
 /********************************************************************
  * Particle Force Registry Class Implementation
 ********************************************************************/
 
-void ParticleForceRegistry::Add(Particle * particle, ParticleForceGenerator *fg)
+ParticleForceRegistry::Handle ParticleForceRegistry::Add(Particle * particle, ParticleForceGenerator *fg)
 {
+    Handle handle;
+    if(!freeHandles.empty())
+    {
+        handle.id = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    else
+    {
+        handle.id = (unsigned)handles.size();
+        handles.push_back({0, 0});
+    }
+    handles[handle.id].slot = (unsigned)registrations.size();
+    handle.generation = handles[handle.id].generation;
+
     // creates a new registry, and assign to it the particle and the fg
     // and then push back to the list of registrations
     ParticleForceRegistry::ParticleForceRegistration registration;
     registration.particle = particle;
     registration.fg = fg;
+    registration.id = handle.id;
     registrations.push_back(registration);
+
+    return handle;
+}
+
+void ParticleForceRegistry::Add(ParticleBatchForce *force)
+{
+    batches.push_back(force);
+}
+
+void ParticleForceRegistry::Remove(Handle handle)
+{
+    if(!IsValid(handle)) return;
+
+    // the registration is only marked, so the registrations keep their
+    // order and the removal doesn't move anything
+    registrations[handles[handle.id].slot].fg = nullptr;
+    releaseHandle(handle.id);
+    removed++;
+}
+
+void ParticleForceRegistry::Remove(const Particle *particle)
+{
+    RemoveIf([particle](const Particle *p, const ParticleForceGenerator *){
+        return p == particle;
+    });
+}
+
+void ParticleForceRegistry::Remove(const ParticleForceGenerator *fg)
+{
+    RemoveIf([fg](const Particle *, const ParticleForceGenerator *f){
+        return f == fg;
+    });
+}
+
+void ParticleForceRegistry::compact()
+{
+    if(removed)
+    {
+        RemoveIf([](const Particle *, const ParticleForceGenerator *){
+            return false;
+        });
+    }
+
+    if(!ordered)
+    {
+        // stable, so the forces on a particle are added in the same order
+        std::stable_sort(registrations.begin(), registrations.end(),
+            [](const ParticleForceRegistration &left, const ParticleForceRegistration &right){
+                const ParticleStore *l = &left.particle->GetStore(), *r = &right.particle->GetStore();
+                if(l != r) return std::less<const ParticleStore*>()(l, r);
+                return left.particle->GetIndex() < right.particle->GetIndex();
+            }
+        );
+
+        for(unsigned i = 0; i < registrations.size(); i++)
+            handles[registrations[i].id].slot = i;
+
+        ordered = true;
+    }
+}
+
+void ParticleForceRegistry::Remap(const ParticleStore &store, const std::vector<unsigned> &remap)
+{
+    for(ParticleBatchForce *force : batches)
+        force->Remap(store, remap);
+}
+
+void ParticleForceRegistry::Update(double time)
+{
+    for(ParticleBatchForce *force : batches)
+        force->Update(time);
+}
+
+void ParticleForceRegistry::Connect(ParticleIslands &islands) const
+{
+    for(const ParticleForceRegistration &registration : registrations)
+    {
+        if(registration.fg != nullptr)
+            islands.Connect(registration.particle, registration.fg->GetOther());
+    }
+
+    for(ParticleBatchForce *force : batches)
+        force->Connect(islands);
 }
 
 void ParticleForceRegistry::UpdateForces(double time)
 {
+    for(ParticleBatchForce *force : batches)
+        force->UpdateForces(time);
+
+    compact();
+
     //loop over all the fg and update all the forces
+    const ParticleStore *lastStore = nullptr;
+    unsigned lastIndex = 0;
     Registry::iterator itr = registrations.begin();
     for(; itr != registrations.end(); itr++)
     {   
+        // removed by a generator during this update
+        if(itr->fg == nullptr) continue;
+
+        // particles can change their store or index after they are
+        // registered, the registry is sorted again on the next update
+        const ParticleStore *store = &itr->particle->GetStore();
+        unsigned index = itr->particle->GetIndex();
+        if(store == lastStore ? index < lastIndex : lastStore && std::less<const ParticleStore*>()(store, lastStore))
+            ordered = false;
+        lastStore = store;
+        lastIndex = index;
+
+        // sleeping particles don't receive forces
+        if(!itr->particle->IsAwake()) continue;
+
         itr->fg->UpdateForce(itr->particle, time);
     }
 }
@@ -51,7 +180,7 @@ GravityGenerator::GravityGenerator(const Point3D &gravity)
 void GravityGenerator::UpdateForce(Particle *particle, double time)
 {
     //don't generate gravity if the particle is massless or has infinite mass
-    if(particle->HasFiniteMass()) return;
+    if(!particle->HasFiniteMass()) return;
 
     // apply the mass-scaled force on the particle
     particle->AddForce(gravity * particle->GetMass());
@@ -62,8 +191,8 @@ void GravityGenerator::UpdateForce(Particle *particle, double time)
  * Spring and Spring-Like Force Generators Class Implementation
 ********************************************************************/
 
-SpringGenerator::SpringGenerator(Particle &other, double spring_constant, double rest_length)
-    : other(other), spring_constant(spring_constant), rest_length(rest_length)
+SpringGenerator::SpringGenerator(Particle &other, real spring_constant, real rest_length)
+    : other(&other), spring_constant(spring_constant), rest_length(rest_length)
 {
 }
 
@@ -73,10 +202,10 @@ void SpringGenerator::UpdateForce(Particle *particle, double time)
     //calculating the vector of the spring
     Point3D force;
     force = particle->GetPosition();
-    force = force - other.GetPosition();
+    force = force - other->GetPosition();
 
     //calculating the magnitude of the force
-    double magnitude = force.Distance(); 
+    real magnitude = force.Distance(); 
     magnitude = std::abs(magnitude - rest_length);
     magnitude *= spring_constant;
 
@@ -86,12 +215,134 @@ void SpringGenerator::UpdateForce(Particle *particle, double time)
     particle->AddForce(force);
 }
 
+SpringNetwork::SpringNetwork(ParticleStore &store)
+: store(store)
+{
+}
+
+unsigned SpringNetwork::Add(unsigned first, unsigned second, real stiffness, real restLength)
+{
+    if(first >= store.GetCount() || second >= store.GetCount())
+        throw std::runtime_error("spring particle is not in the store");
+
+    this->first.push_back(first);
+    this->second.push_back(second);
+    this->stiffness.push_back(stiffness);
+    this->restLength.push_back(restLength);
+
+    return GetCount() - 1;
+}
+
+unsigned SpringNetwork::Add(const Particle &first, const Particle &second, real stiffness, real restLength)
+{
+    if(!first.IsIn(store) || !second.IsIn(store))
+        throw std::runtime_error("spring particle is not in the store");
+
+    return Add(first.GetIndex(), second.GetIndex(), stiffness, restLength);
+}
+
+void SpringNetwork::Reserve(unsigned count)
+{
+    first.reserve(count);
+    second.reserve(count);
+    stiffness.reserve(count);
+    restLength.reserve(count);
+}
+
+void SpringNetwork::Clear()
+{
+    first.clear();
+    second.clear();
+    stiffness.clear();
+    restLength.clear();
+}
+
+void SpringNetwork::Remap(const ParticleStore &store, const std::vector<unsigned> &remap)
+{
+    if(&store != &this->store) return;
+
+    unsigned kept = 0;
+    for(unsigned s = 0; s < GetCount(); s++)
+    {
+        unsigned i = first[s] < remap.size() ? remap[first[s]] : ParticleStore::NoIndex;
+        unsigned j = second[s] < remap.size() ? remap[second[s]] : ParticleStore::NoIndex;
+        if(i == ParticleStore::NoIndex || j == ParticleStore::NoIndex) continue;
+
+        first[kept] = i;
+        second[kept] = j;
+        stiffness[kept] = stiffness[s];
+        restLength[kept] = restLength[s];
+        kept++;
+    }
+
+    first.resize(kept);
+    second.resize(kept);
+    stiffness.resize(kept);
+    restLength.resize(kept);
+}
+
+void SpringNetwork::UpdateForces(double /*time*/)
+{
+    const unsigned count = GetCount();
+    const unsigned Axes = ParticleStore::Axes;
+
+    const unsigned *first = this->first.data(), *second = this->second.data();
+    const real *stiffness = this->stiffness.data(), *restLength = this->restLength.data();
+
+    const real *position[Axes];
+    real *force[Axes];
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        this->force[a].resize(count);
+        position[a] = store.position[a].data();
+        force[a] = this->force[a].data();
+    }
+
+    // work out the forces without branches so the loop vectorizes
+    for(unsigned s = 0; s < count; s++)
+    {
+        real delta[Axes], lengthSq = 0;
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            delta[a] = position[a][first[s]] - position[a][second[s]];
+            lengthSq += delta[a] * delta[a];
+        }
+
+        // particles at the same place don't get a direction
+        real length = std::sqrt(lengthSq);
+        real scale = length > 0 ? stiffness[s] * (restLength[s] - length) / length : 0;
+
+        for(unsigned a = 0; a < Axes; a++)
+            force[a][s] = delta[a] * scale;
+    }
+
+    // particles are shared between springs, so the forces are added
+    // serially. The ends of a spring are in the same island, so they
+    // are either both asleep or both awake.
+    const unsigned char *asleep = store.asleep.data();
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        real *accum = store.forceAccum[a].data();
+        for(unsigned s = 0; s < count; s++)
+        {
+            if(!asleep[first[s]])  accum[first[s]]  += force[a][s];
+            if(!asleep[second[s]]) accum[second[s]] -= force[a][s];
+        }
+    }
+}
+
+void SpringNetwork::Connect(ParticleIslands &islands) const
+{
+    for(unsigned s = 0; s < GetCount(); s++)
+        islands.Connect(store, first[s], second[s]);
+}
+
 SpringAnchorGenerator::SpringAnchorGenerator()
 {
 
 };
 
-SpringAnchorGenerator::SpringAnchorGenerator(Point3D &other, double sc, double rl)
+SpringAnchorGenerator::SpringAnchorGenerator(Point3D &other, real sc, real rl)
     : anchor(other), spring_constant(sc), rest_length(rl)
 { };
 
@@ -104,7 +355,7 @@ void SpringAnchorGenerator::UpdateForce(Particle *particle, double time)
     force = force - anchor;
 
     //calculating the magnitude of the spring
-    double magintude = force.Distance();
+    real magintude = force.Distance();
     magintude = (rest_length - magintude) * spring_constant;
 
     //calculating the final force and then apply it
@@ -113,8 +364,8 @@ void SpringAnchorGenerator::UpdateForce(Particle *particle, double time)
     particle->AddForce(force);
 }
 
-BungeeGenerator::BungeeGenerator(Particle &other, double sc, double rl)
-: other(other), springConstant(sc), restLength(rl)
+BungeeGenerator::BungeeGenerator(Particle &other, real sc, real rl)
+: other(&other), springConstant(sc), restLength(rl)
 {
 }
 
@@ -123,10 +374,10 @@ void BungeeGenerator::UpdateForce(Particle *particle, double time)
     //calculating the vector of the spring
     Point3D force;
     force = particle->GetPosition();
-    force = force - other.GetPosition();
+    force = force - other->GetPosition();
 
     //check if the bungee is compressed
-    double magintude = force.Distance();
+    real magintude = force.Distance();
     if(magintude <= restLength) return;
 
     //calculating the magintude of the force
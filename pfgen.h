@@ -22,6 +22,7 @@
 #pragma once
 
 #include <Gorgon/Physics/particle.h>
+#include <Gorgon/Physics/pislands.h>
 #include <Gorgon/Geometry/Point3D.h>
 #include <vector>
 
@@ -40,6 +41,55 @@ namespace Gorgon
              * to calculate, update and performe the force-specific calculations
              */
             virtual void UpdateForce(Gorgon::Physics::Particle *particle, double time) = 0;
+
+            /**
+             * Returns the particle, other than the registered one, that
+             * the force depends on, such as the other end of a spring, or
+             * nullptr. The world drops the registrations of the generator
+             * when this particle is removed, and keeps the two particles
+             * in the same island so they fall asleep together.
+             */
+            virtual const Gorgon::Physics::Particle *GetOther() const{
+                return nullptr;
+            }
+        };
+
+        /**
+         * A force that's applied to many particles of a store in a
+         * single pass, instead of one call per particle.
+         */
+        class ParticleBatchForce
+        {
+        public:
+            virtual ~ParticleBatchForce(){ }
+
+            /**
+             * Adds the forces to the accumulators of the particles. It
+             * may be called more than once in a step, such as by
+             * multi-stage integrators, so it should only add forces.
+             */
+            virtual void UpdateForces(double time) = 0;
+
+            /**
+             * Called once per step before the forces, for the work that
+             * must not repeat when the forces are evaluated again, such
+             * as ageing particles
+             */
+            virtual void Update(double /*time*/){ }
+
+            /**
+             * Joins the islands of the particles that the force couples,
+             * so they fall asleep and wake up together
+             */
+            virtual void Connect(ParticleIslands &/*islands*/) const{ }
+
+            /**
+             * Updates the particle indices that the force keeps after the
+             * given store is compacted or particles are removed from it.
+             * The remap holds the new index of each old one, or NoIndex
+             * for the removed particles.
+             */
+            virtual void Remap(const ParticleStore &/*store*/, const std::vector<unsigned> &/*remap*/){ }
         };
 
         /**
@@ -57,85 +107,345 @@ namespace Gorgon
         };
 
 
+        /**
+         * A spring towards another particle. The other particle is
+         * referred to, not copied, so it should live as long as the
+         * generator.
+         */
         class SpringGenerator : public ParticleForceGenerator
         {
-            Particle other;
+            Particle *other;
 
-            double spring_constant;
+            real spring_constant;
 
-            double rest_length;
+            real rest_length;
 
         public:
-            SpringGenerator(Particle &particle, double spring_constant, double rest_length);
+            SpringGenerator(Particle &particle, real spring_constant, real rest_length);
 
             virtual void UpdateForce(Particle *particle, double time);
+
+            virtual const Particle *GetOther() const override{
+                return other;
+            }
         };
 
         class SpringAnchorGenerator : public ParticleForceGenerator
         {
             Point3D anchor;
 
-            double spring_constant;
+            real spring_constant;
 
-            double rest_length;
+            real rest_length;
 
         public: 
             SpringAnchorGenerator();
 
-            SpringAnchorGenerator(Point3D &anchor, double spring_constant, double rest_length);
+            SpringAnchorGenerator(Point3D &anchor, real spring_constant, real rest_length);
 
             const Point3D GetAnchor() const {return anchor;}
 
-            void init(Point3D &anchor, double spring_constant, double rest_length);
+            void init(Point3D &anchor, real spring_constant, real rest_length);
 
             virtual void UpdateForce(Particle *Particle, double time);
         };
 
 
              
+        /**
+         * A bungee towards another particle, which only pulls when it's
+         * stretched. The other particle is referred to, not copied.
+         */
         class BungeeGenerator : public ParticleForceGenerator
         {
             
-            Particle other;
+            Particle *other;
 
-            double springConstant;
+            real springConstant;
 
-            double restLength;
+            real restLength;
 
         public:
 
             BungeeGenerator(Particle &other,
-                double springConstant, double restLength);
+                real springConstant, real restLength);
 
             virtual void UpdateForce(Particle *particle, double duration);
+
+            virtual const Particle *GetOther() const override{
+                return other;
+            }
+        };
+
+        /**
+         * A network of springs between the particles of a store. The
+         * springs are kept as arrays of particle indices, stiffnesses
+         * and rest lengths, and all spring forces are worked out in one
+         * pass over the arrays, then added to the force accumulators.
+         * Each spring pulls both of its particles towards its rest
+         * length. Sleeping particles don't receive spring forces.
+         */
+        class SpringNetwork : public ParticleBatchForce
+        {
+        public:
+            /**
+             * Creates an empty network over the particles of the
+             * given store
+             */
+            SpringNetwork(ParticleStore &store);
+
+            /**
+             * Adds a spring between the particles at the given indices
+             * and returns the index of the spring
+             */
+            unsigned Add(unsigned first, unsigned second, real stiffness, real restLength);
+
+            /**
+             * Adds a spring between the given particles, which should
+             * be in the store of the network
+             */
+            unsigned Add(const Particle &first, const Particle &second, real stiffness, real restLength);
+
+            /**
+             * Reserves memory for the given number of springs
+             */
+            void Reserve(unsigned count);
+
+            /**
+             * Removes all springs
+             */
+            void Clear();
+
+            inline unsigned GetCount() const{
+                return (unsigned)first.size();
+            };
+
+            inline ParticleStore &GetStore() const{
+                return store;
+            };
+
+            /**
+             * Returns the store indices of the particles of a spring
+             */
+            inline unsigned GetFirst(unsigned spring) const{
+                return first[spring];
+            };
+            inline unsigned GetSecond(unsigned spring) const{
+                return second[spring];
+            };
+
+            inline void SetStiffness(unsigned spring, real value){
+                stiffness[spring] = value;
+            };
+            inline real GetStiffness(unsigned spring) const{
+                return stiffness[spring];
+            };
+
+            inline void SetRestLength(unsigned spring, real value){
+                restLength[spring] = value;
+            };
+            inline real GetRestLength(unsigned spring) const{
+                return restLength[spring];
+            };
+
+            virtual void UpdateForces(double time) override;
+
+            /**
+             * Joins the two ends of each spring, so a network forms a
+             * single island
+             */
+            virtual void Connect(ParticleIslands &islands) const override;
+
+            /**
+             * Moves the springs to the new indices of their particles,
+             * the springs of the removed particles are dropped
+             */
+            virtual void Remap(const ParticleStore &store, const std::vector<unsigned> &remap) override;
+
+        protected:
+            ParticleStore &store;
+
+            std::vector<unsigned> first;
+            std::vector<unsigned> second;
+            std::vector<real> stiffness;
+            std::vector<real> restLength;
+
+            /**
+             * Force of each spring on its first particle, the second
+             * particle receives the opposite force
+             */
+            std::vector<real> force[ParticleStore::Axes];
         };
 
         /**
          * Holds all the force generators and the particles they apply to.
+         * The registrations are kept grouped by particle, in the order of
+         * the particles in their store, so the forces are accumulated
+         * walking the store forwards. Registrations that are added out of
+         * order are sorted before the next update.
          */
         class ParticleForceRegistry
         {
+        public:
+            /**
+             * Refers to a registration until it's removed
+             */
+            struct Handle
+            {
+                unsigned id = (unsigned)-1;
+                unsigned generation = 0;
+
+                inline bool operator==(const Handle &other) const{
+                    return id == other.id && generation == other.generation;
+                };
+                inline bool operator!=(const Handle &other) const{
+                    return !(*this == other);
+                };
+            };
+
         protected:
             /**
              * This struct is the represenation of each force registration.
              * It keeps track with one force and its particle and the attached
-             * force generator.
+             * force generator. Registrations that are removed by their
+             * handle have a null generator until the registry is compacted.
              */
             struct ParticleForceRegistration
             {
                 Gorgon::Physics::Particle *particle;
                 ParticleForceGenerator *fg;
+                unsigned id;
             };
 
             typedef std::vector<ParticleForceRegistration> Registry;
             Registry registrations;
 
+            std::vector<ParticleBatchForce*> batches;
+
+            /**
+             * An entry of the handle table: the place of the registration
+             * and how many times the entry was released
+             */
+            struct HandleEntry
+            {
+                unsigned slot;
+                unsigned generation;
+            };
+
+            std::vector<HandleEntry> handles;
+            std::vector<unsigned> freeHandles;
+
+            /**
+             * Number of registrations that are removed but not yet
+             * compacted away
+             */
+            unsigned removed = 0;
+
+            /**
+             * False when the registrations are not grouped by particle
+             */
+            bool ordered = true;
+
+            void releaseHandle(unsigned id){
+                handles[id].slot = (unsigned)-1;
+                handles[id].generation++;
+                freeHandles.push_back(id);
+            };
+
+            /**
+             * Drops the removed registrations and sorts the rest by
+             * particle if needed
+             */
+            void compact();
+
         public:
             /**
              * It creates and new ParticleRegistration and store it
-             * to keep track with it
+             * to keep track with it. The returned handle can be used to
+             * remove the registration.
+             */
+            Handle Add(Gorgon::Physics::Particle *particle, ParticleForceGenerator *fg);
+
+            /**
+             * Adds a force that's applied to its particles in a single
+             * pass. The force is not owned by the registry.
+             */
+            void Add(ParticleBatchForce *force);
+
+            /**
+             * Removes the registration in constant time. Removing a
+             * registration that's already removed does nothing.
+             */
+            void Remove(Handle handle);
+
+            /**
+             * Removes all registrations of the given particle
+             */
+            void Remove(const Gorgon::Physics::Particle *particle);
+
+            /**
+             * Removes all registrations of the given force generator
+             */
+            void Remove(const ParticleForceGenerator *fg);
+
+            /**
+             * Removes the registrations for which fn(particle, generator)
+             * returns true, in a single pass over the registry
+             */
+            template<class F_>
+            void RemoveIf(F_ fn){
+                unsigned kept = 0;
+                for(unsigned i = 0; i < registrations.size(); i++)
+                {
+                    ParticleForceRegistration &registration = registrations[i];
+                    if(registration.fg == nullptr) continue;
+
+                    if(fn((const Particle*)registration.particle, (const ParticleForceGenerator*)registration.fg))
+                    {
+                        releaseHandle(registration.id);
+                        continue;
+                    }
+
+                    handles[registration.id].slot = kept;
+                    registrations[kept++] = registration;
+                }
+
+                registrations.resize(kept);
+                removed = 0;
+            };
+
+            /**
+             * Returns whether the registration is not removed
+             */
+            inline bool IsValid(Handle handle) const{
+                return handle.id < handles.size() && handles[handle.id].generation == handle.generation;
+            };
+
+            /**
+             * Returns the number of registrations
+             */
+            inline unsigned GetCount() const{
+                return (unsigned)registrations.size() - removed;
+            };
+
+            /**
+             * Remaps the particle indices of the batch forces, see
+             * ParticleBatchForce::Remap
+             */
+            void Remap(const ParticleStore &store, const std::vector<unsigned> &remap);
+
+            /**
+             * Updates the batch forces once for a step, see
+             * ParticleBatchForce::Update
+             */
+            void Update(double time);
+
+            /**
+             * Joins the islands of the particles that the forces couple,
+             * such as the two ends of a spring, see
+             * ParticleBatchForce::Connect
              */
-            void Add(Gorgon::Physics::Particle *particle, ParticleForceGenerator *fg);
+            void Connect(ParticleIslands &islands) const;
 
             /**
              * It calls all the force generators and
@@ -0,0 +1,226 @@
+/**
+ * @file pimplicit.cpp is the implementation for pimplicit.h
+ */
+#include <Gorgon/Physics/pimplicit.h>
+#include <algorithm>
+#include <cmath>
+
+using Gorgon::Physics::ImplicitEuler;
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::SpringNetwork;
+using Gorgon::Physics::real;
+
+namespace
+{
+    const unsigned Axes = ParticleStore::Axes;
+
+    // sums in double, so the solver converges in a float build as well
+    double dot(const std::vector<real> &a, const std::vector<real> &b)
+    {
+        double sum = 0;
+        for(size_t i = 0; i < a.size(); i++)
+            sum += a[i] * b[i];
+        return sum;
+    }
+}
+
+void ImplicitEuler::Add(const SpringNetwork &springs)
+{
+    networks.push_back(&springs);
+}
+
+void ImplicitEuler::Clear()
+{
+    networks.clear();
+}
+
+void ImplicitEuler::linearize(const ParticleStore &store)
+{
+    first.clear();
+    second.clear();
+    along.clear();
+    across.clear();
+    for(unsigned a = 0; a < Axes; a++)
+        direction[a].clear();
+
+    for(const SpringNetwork *springs : networks)
+    {
+        if(&springs->GetStore() != &store) continue;
+
+        for(unsigned s = 0; s < springs->GetCount(); s++)
+        {
+            unsigned i = springs->GetFirst(s), j = springs->GetSecond(s);
+            if(mass[i] == 0 && mass[j] == 0) continue;
+
+            real delta[Axes], lengthSq = 0;
+            for(unsigned a = 0; a < Axes; a++)
+            {
+                delta[a] = store.position[a][i] - store.position[a][j];
+                lengthSq += delta[a] * delta[a];
+            }
+
+            real length = std::sqrt(lengthSq);
+            if(length == 0) continue;
+
+            first.push_back(i);
+            second.push_back(j);
+            for(unsigned a = 0; a < Axes; a++)
+                direction[a].push_back(delta[a] / length);
+
+            // the stiffness across the spring is dropped while it's
+            // compressed, otherwise the system isn't positive definite
+            real k = springs->GetStiffness(s);
+            along.push_back(k);
+            across.push_back(k * std::max(real(0), 1 - springs->GetRestLength(s) / length));
+        }
+    }
+}
+
+void ImplicitEuler::stiffness(const std::vector<real> &x, std::vector<real> &y) const
+{
+    size_t n = mass.size();
+    std::fill(y.begin(), y.end(), 0.0);
+
+    for(size_t s = 0; s < first.size(); s++)
+    {
+        size_t i = first[s], j = second[s];
+
+        real u[Axes], projected = 0;
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            u[a] = x[a * n + i] - x[a * n + j];
+            projected += u[a] * direction[a][s];
+        }
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            real parallel = projected * direction[a][s];
+            real f = along[s] * parallel + across[s] * (u[a] - parallel);
+            y[a * n + i] += f;
+            y[a * n + j] -= f;
+        }
+    }
+}
+
+void ImplicitEuler::multiply(const std::vector<real> &x, std::vector<real> &y, real timeSq) const
+{
+    size_t n = mass.size();
+    stiffness(x, y);
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            size_t k = a * n + i;
+            y[k] = mass[i] > 0 ? mass[i] * x[k] + timeSq * y[k] : 0;
+        }
+    }
+}
+
+void ImplicitEuler::step(ParticleStore &store, double time)
+{
+    size_t n = store.GetCount(), size = n * Axes;
+    real h = real(time), timeSq = real(time * time);
+
+    mass.resize(n);
+    for(size_t i = 0; i < n; i++)
+        mass[i] = store.IsActive((unsigned)i) ? 1 / store.inverseMass[i] : 0;
+
+    linearize(store);
+
+    for(std::vector<real> *v : {&dv, &rhs, &residual, &search, &product, &precond, &kv})
+        v->resize(size);
+
+    // right hand side: h (f + M a) - h^2 K v
+    for(unsigned a = 0; a < Axes; a++)
+        std::copy(store.velocity[a].begin(), store.velocity[a].end(), search.begin() + a * n);
+    stiffness(search, kv);
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            size_t k = a * n + i;
+            rhs[k] = mass[i] > 0 ?
+                h * (store.forceAccum[a][i] + mass[i] * store.acceleration[a][i]) - timeSq * kv[k] : 0;
+        }
+    }
+
+    // the preconditioner is the inverse of the diagonal of the system
+    std::fill(precond.begin(), precond.end(), 0.0);
+    for(size_t s = 0; s < first.size(); s++)
+    {
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            real d = direction[a][s] * direction[a][s];
+            real diagonal = timeSq * (along[s] * d + across[s] * (1 - d));
+            precond[a * n + first[s]] += diagonal;
+            precond[a * n + second[s]] += diagonal;
+        }
+    }
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            size_t k = a * n + i;
+            precond[k] = mass[i] > 0 ? 1 / (mass[i] + precond[k]) : 0;
+        }
+    }
+
+    // preconditioned conjugate gradient, starting from no change
+    std::fill(dv.begin(), dv.end(), 0.0);
+    residual = rhs;
+
+    double limit = tolerance * tolerance * dot(rhs, rhs);
+    double rz = 0;
+    for(size_t k = 0; k < size; k++)
+    {
+        search[k] = precond[k] * residual[k];
+        rz += residual[k] * search[k];
+    }
+
+    iterationsUsed = 0;
+    while(iterationsUsed < iterations && dot(residual, residual) > limit)
+    {
+        multiply(search, product, timeSq);
+
+        real alpha = real(rz / dot(search, product));
+        for(size_t k = 0; k < size; k++)
+        {
+            dv[k] += alpha * search[k];
+            residual[k] -= alpha * product[k];
+        }
+
+        double next = 0;
+        for(size_t k = 0; k < size; k++)
+            next += residual[k] * precond[k] * residual[k];
+
+        real beta = real(next / rz);
+        for(size_t k = 0; k < size; k++)
+            search[k] = precond[k] * residual[k] + beta * search[k];
+
+        rz = next;
+        iterationsUsed++;
+    }
+
+    // apply the velocity change, then move with the new velocity
+    real lastDamping = 1, drag = 1;
+    for(size_t i = 0; i < n; i++)
+    {
+        if(mass[i] == 0) continue;
+
+        if(store.damping[i] != lastDamping)
+        {
+            lastDamping = store.damping[i];
+            drag = std::pow(lastDamping, time);
+        }
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            real &v = store.velocity[a][i];
+            v = (v + dv[a * n + i]) * drag;
+            store.position[a][i] += v * h;
+            store.forceAccum[a][i] = 0;
+        }
+    }
+}
@@ -0,0 +1,314 @@
+/**
+ * @file pintegrate.cpp is the implementation for pintegrate.h
+ */
+#include <Gorgon/Physics/pintegrate.h>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#   define PHYSICS_X86
+#   include <immintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#endif
+
+// GCC and Clang need the target attribute to emit AVX2 code in a
+// translation unit that isn't compiled with -mavx2
+#if defined(PHYSICS_X86) && (defined(__GNUC__) || defined(__clang__))
+#   define PHYSICS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#   define PHYSICS_TARGET_AVX2
+#endif
+
+using Gorgon::Physics::ParticleIntegrator;
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::real;
+
+const double ParticleIntegrator::Tolerance = sizeof(real) == sizeof(float) ? 1e-5 : 1e-12;
+
+namespace
+{
+    /**
+     * Holds the arrays of one axis of a store
+     */
+    struct AxisBlock
+    {
+        real *pos;
+        real *vel;
+        const real *acc;
+        real *force;
+    };
+
+    /**
+     * Integrates one axis of the particles. It performs the same steps
+     * as ParticleStore::Integrate. Particles with zero or negative
+     * inverse mass are left untouched.
+     */
+    void integrateScalar(AxisBlock axis, const real *inverseMass, const real *drag,
+                         unsigned begin, unsigned end, real time)
+    {
+        for(unsigned i = begin; i < end; i++)
+        {
+            if(inverseMass[i] <= 0)
+                continue;
+
+            axis.pos[i] += axis.vel[i] * time;
+            axis.vel[i] += (axis.acc[i] + axis.force[i] * inverseMass[i]) * time;
+            axis.vel[i] *= drag[i];
+            axis.force[i] = 0;
+        }
+    }
+
+#ifdef PHYSICS_X86
+#   ifdef GORGON_PHYSICS_FLOAT
+    // the float kernels handle twice as many particles per instruction
+    unsigned integrateSSE2(AxisBlock axis, const real *inverseMass, const real *drag,
+                           unsigned count, real time)
+    {
+        const __m128 t = _mm_set1_ps(time);
+        const __m128 zero = _mm_setzero_ps();
+
+        unsigned i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m128 im = _mm_loadu_ps(inverseMass + i);
+            __m128 active = _mm_cmpgt_ps(im, zero);
+
+            __m128 pos = _mm_loadu_ps(axis.pos + i);
+            __m128 vel = _mm_loadu_ps(axis.vel + i);
+            __m128 acc = _mm_loadu_ps(axis.acc + i);
+            __m128 force = _mm_loadu_ps(axis.force + i);
+
+            __m128 newPos = _mm_add_ps(pos, _mm_mul_ps(vel, t));
+            __m128 resAcc = _mm_add_ps(acc, _mm_mul_ps(force, im));
+            __m128 newVel = _mm_add_ps(vel, _mm_mul_ps(resAcc, t));
+            newVel = _mm_mul_ps(newVel, _mm_loadu_ps(drag + i));
+
+            // keep the old values of the inactive particles
+            pos = _mm_or_ps(_mm_and_ps(active, newPos), _mm_andnot_ps(active, pos));
+            vel = _mm_or_ps(_mm_and_ps(active, newVel), _mm_andnot_ps(active, vel));
+            force = _mm_andnot_ps(active, force);
+
+            _mm_storeu_ps(axis.pos + i, pos);
+            _mm_storeu_ps(axis.vel + i, vel);
+            _mm_storeu_ps(axis.force + i, force);
+        }
+
+        return i;
+    }
+
+    PHYSICS_TARGET_AVX2
+    unsigned integrateAVX2(AxisBlock axis, const real *inverseMass, const real *drag,
+                           unsigned count, real time)
+    {
+        const __m256 t = _mm256_set1_ps(time);
+        const __m256 zero = _mm256_setzero_ps();
+
+        unsigned i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m256 im = _mm256_loadu_ps(inverseMass + i);
+            __m256 active = _mm256_cmp_ps(im, zero, _CMP_GT_OQ);
+
+            __m256 pos = _mm256_loadu_ps(axis.pos + i);
+            __m256 vel = _mm256_loadu_ps(axis.vel + i);
+            __m256 acc = _mm256_loadu_ps(axis.acc + i);
+            __m256 force = _mm256_loadu_ps(axis.force + i);
+
+            // explicit mul and add, no FMA, to match the scalar path
+            __m256 newPos = _mm256_add_ps(pos, _mm256_mul_ps(vel, t));
+            __m256 resAcc = _mm256_add_ps(acc, _mm256_mul_ps(force, im));
+            __m256 newVel = _mm256_add_ps(vel, _mm256_mul_ps(resAcc, t));
+            newVel = _mm256_mul_ps(newVel, _mm256_loadu_ps(drag + i));
+
+            // keep the old values of the inactive particles
+            pos = _mm256_blendv_ps(pos, newPos, active);
+            vel = _mm256_blendv_ps(vel, newVel, active);
+            force = _mm256_andnot_ps(active, force);
+
+            _mm256_storeu_ps(axis.pos + i, pos);
+            _mm256_storeu_ps(axis.vel + i, vel);
+            _mm256_storeu_ps(axis.force + i, force);
+        }
+
+        return i;
+    }
+
+#   else
+    unsigned integrateSSE2(AxisBlock axis, const real *inverseMass, const real *drag,
+                           unsigned count, real time)
+    {
+        const __m128d t = _mm_set1_pd(time);
+        const __m128d zero = _mm_setzero_pd();
+
+        unsigned i = 0;
+        for(; i + 2 <= count; i += 2)
+        {
+            __m128d im = _mm_loadu_pd(inverseMass + i);
+            __m128d active = _mm_cmpgt_pd(im, zero);
+
+            __m128d pos = _mm_loadu_pd(axis.pos + i);
+            __m128d vel = _mm_loadu_pd(axis.vel + i);
+            __m128d acc = _mm_loadu_pd(axis.acc + i);
+            __m128d force = _mm_loadu_pd(axis.force + i);
+
+            __m128d newPos = _mm_add_pd(pos, _mm_mul_pd(vel, t));
+            __m128d resAcc = _mm_add_pd(acc, _mm_mul_pd(force, im));
+            __m128d newVel = _mm_add_pd(vel, _mm_mul_pd(resAcc, t));
+            newVel = _mm_mul_pd(newVel, _mm_loadu_pd(drag + i));
+
+            // keep the old values of the inactive particles
+            pos = _mm_or_pd(_mm_and_pd(active, newPos), _mm_andnot_pd(active, pos));
+            vel = _mm_or_pd(_mm_and_pd(active, newVel), _mm_andnot_pd(active, vel));
+            force = _mm_andnot_pd(active, force);
+
+            _mm_storeu_pd(axis.pos + i, pos);
+            _mm_storeu_pd(axis.vel + i, vel);
+            _mm_storeu_pd(axis.force + i, force);
+        }
+
+        return i;
+    }
+
+    PHYSICS_TARGET_AVX2
+    unsigned integrateAVX2(AxisBlock axis, const real *inverseMass, const real *drag,
+                           unsigned count, real time)
+    {
+        const __m256d t = _mm256_set1_pd(time);
+        const __m256d zero = _mm256_setzero_pd();
+
+        unsigned i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            __m256d im = _mm256_loadu_pd(inverseMass + i);
+            __m256d active = _mm256_cmp_pd(im, zero, _CMP_GT_OQ);
+
+            __m256d pos = _mm256_loadu_pd(axis.pos + i);
+            __m256d vel = _mm256_loadu_pd(axis.vel + i);
+            __m256d acc = _mm256_loadu_pd(axis.acc + i);
+            __m256d force = _mm256_loadu_pd(axis.force + i);
+
+            // explicit mul and add, no FMA, to match the scalar path
+            __m256d newPos = _mm256_add_pd(pos, _mm256_mul_pd(vel, t));
+            __m256d resAcc = _mm256_add_pd(acc, _mm256_mul_pd(force, im));
+            __m256d newVel = _mm256_add_pd(vel, _mm256_mul_pd(resAcc, t));
+            newVel = _mm256_mul_pd(newVel, _mm256_loadu_pd(drag + i));
+
+            // keep the old values of the inactive particles
+            pos = _mm256_blendv_pd(pos, newPos, active);
+            vel = _mm256_blendv_pd(vel, newVel, active);
+            force = _mm256_andnot_pd(active, force);
+
+            _mm256_storeu_pd(axis.pos + i, pos);
+            _mm256_storeu_pd(axis.vel + i, vel);
+            _mm256_storeu_pd(axis.force + i, force);
+        }
+
+        return i;
+    }
+
+#   endif
+
+    bool supportsAVX2()
+    {
+#   if defined(__GNUC__) || defined(__clang__)
+        return __builtin_cpu_supports("avx2");
+#   elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if(info[0] < 7) return false;
+
+        // the OS should save the AVX registers as well
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if(!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#   else
+        return false;
+#   endif
+    }
+#endif
+}
+
+ParticleIntegrator::ParticleIntegrator()
+: path(Detect())
+{
+}
+
+ParticleIntegrator::Path ParticleIntegrator::Detect()
+{
+#ifdef PHYSICS_X86
+    static const Path best = supportsAVX2() ? Path::AVX2 : Path::SSE2;
+    return best;
+#else
+    return Path::Scalar;
+#endif
+}
+
+void ParticleIntegrator::SetPath(Path path)
+{
+    Path best = Detect();
+    this->path = (int)path > (int)best ? best : path;
+}
+
+void ParticleIntegrator::Integrate(ParticleStore &store, double time)
+{
+    // abort the program if the time elapsed
+    // between frames is less than zero
+    if(time < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    unsigned count = store.GetCount();
+
+    /**
+     * Work out the drag of each particle first. Particles usually
+     * share the same damping, so pow is only called when the damping
+     * changes from one particle to the next.
+     */
+    drag.resize(count);
+    activeMass.resize(count);
+    real lastDamping = 1, lastDrag = 1;
+    for(unsigned i = 0; i < count; i++)
+    {
+        real damping = store.damping[i];
+        if(damping != lastDamping)
+        {
+            lastDamping = damping;
+            lastDrag = pow(damping, time);
+        }
+        drag[i] = lastDrag;
+
+        activeMass[i] = store.asleep[i] ? 0 : store.inverseMass[i];
+    }
+    const real *inverseMass = activeMass.data();
+
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+    {
+        AxisBlock axis = {
+            store.position[a].data(), store.velocity[a].data(),
+            store.acceleration[a].data(), store.forceAccum[a].data()
+        };
+
+        unsigned done = 0;
+        switch(path)
+        {
+#ifdef PHYSICS_X86
+        case Path::AVX2:
+            done = integrateAVX2(axis, inverseMass, drag.data(), count, time);
+            break;
+        case Path::SSE2:
+            done = integrateSSE2(axis, inverseMass, drag.data(), count, time);
+            break;
+#endif
+        default:
+            break;
+        }
+
+        // the remaining particles that don't fill a whole block
+        integrateScalar(axis, inverseMass, drag.data(), done, count, time);
+    }
+}
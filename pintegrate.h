@@ -0,0 +1,88 @@
+/**
+ * @file pintegrate.h contains the batch integrator for particle stores
+ *
+ * @brief The batch integrator integrates all the particles of a store
+ * in one go, using the widest SIMD instruction set the processor
+ * supports. The instruction set is detected at runtime; AVX2 and SSE2
+ * kernels are available on x86 and the scalar kernel is used everywhere
+ * else. An AVX2 instruction handles four particles in the double build
+ * and eight in the float build.
+ *
+ * The kernels perform the same operations in the same order as
+ * ParticleStore::Integrate without fused multiply-add, so all paths
+ * give the same results as the scalar path. When the compiler contracts
+ * the scalar path into FMA instructions the results may differ by
+ * rounding only, which is bounded by Tolerance (relative error per step).
+ */
+#pragma once
+
+#include <Gorgon/Physics/pstore.h>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ParticleIntegrator
+        {
+        public:
+            /**
+             * The instruction set used by the kernels
+             */
+            enum class Path
+            {
+                Scalar,
+                SSE2,
+                AVX2
+            };
+
+            /**
+             * Maximum relative difference between the results of the
+             * SIMD paths and the scalar path for a single step.
+             */
+            static const double Tolerance;
+
+            /**
+             * Creates a new integrator that uses the best path
+             * supported by the processor
+             */
+            ParticleIntegrator();
+
+            /**
+             * Returns the best path supported by the processor
+             */
+            static Path Detect();
+
+            /**
+             * Sets the path to be used. If the processor doesn't support
+             * the given path, the best supported one is used instead.
+             */
+            void SetPath(Path path);
+
+            inline Path GetPath() const{
+                return path;
+            };
+
+            /**
+             * Integrates all the particles in the given store forward
+             * in time by the given duration.
+             */
+            void Integrate(ParticleStore &store, double time);
+
+        protected:
+            Path path;
+
+            /**
+             * Holds the per particle drag factor of the current step.
+             * It's kept between the frames to avoid reallocation.
+             */
+            std::vector<real> drag;
+
+            /**
+             * Holds the inverse mass of each particle for the current
+             * step, zero for the sleeping ones so the kernels skip them.
+             */
+            std::vector<real> activeMass;
+        };
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * @file pintegrators.h contains the integrator policies
+ *
+ * @brief An integrator policy holds the math that moves the particles of
+ * a store forward in time. basic_ParticleWorld takes the policy as a
+ * template parameter, so the math is chosen at compile time and inlined
+ * into the loop over the particles without any virtual call per particle.
+ *
+ * A policy has two members:
+ *
+ *  - Integrate(store, time, forces) moves the active particles forward
+ *    and clears their accumulators. forces is a callable that clears the
+ *    accumulators and runs the force registry again; multi-stage policies
+ *    call it to evaluate the forces at an intermediate state.
+ *  - Finish(store, time) is called after the contacts of the step are
+ *    resolved.
+ *
+ * All policies apply the damping as a drag of damping^time per step, as
+ * the default integrator does.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pstore.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        namespace Integrators
+        {
+            /**
+             * Calls the kernel for each axis of each active particle with
+             * its position, velocity, resulting acceleration and drag,
+             * then clears the force accumulator of the particle.
+             */
+            template<class Kernel_>
+            inline void Apply(ParticleStore &store, double time, Kernel_ kernel)
+            {
+                unsigned count = store.GetCount();
+                real lastDamping = 1, drag = 1;
+
+                for(unsigned i = 0; i < count; i++)
+                {
+                    if(!store.IsActive(i)) continue;
+
+                    // particles usually share the same damping
+                    if(store.damping[i] != lastDamping)
+                    {
+                        lastDamping = store.damping[i];
+                        drag = std::pow(lastDamping, time);
+                    }
+
+                    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    {
+                        real acc = store.acceleration[a][i] + store.forceAccum[a][i] * store.inverseMass[i];
+                        kernel(i, a, store.position[a][i], store.velocity[a][i], acc, drag);
+                        store.forceAccum[a][i] = 0;
+                    }
+                }
+            }
+        }
+
+        /**
+         * Explicit Euler, the position is updated with the old velocity.
+         * This is the integrator of the default world.
+         */
+        struct ExplicitEuler
+        {
+            template<class Forces_>
+            void Integrate(ParticleStore &store, double time, Forces_ &&){
+                real h = real(time);
+                Integrators::Apply(store, time, [h](unsigned, unsigned, real &x, real &v, real acc, real drag){
+                    x += v * h;
+                    v = (v + acc * h) * drag;
+                });
+            }
+
+            void Finish(ParticleStore &, double){ }
+        };
+
+        /**
+         * Semi-implicit (symplectic) Euler, the position is updated with
+         * the new velocity. It keeps the energy of oscillating systems
+         * such as springs bounded at the same cost as explicit Euler.
+         */
+        struct SemiImplicitEuler
+        {
+            template<class Forces_>
+            void Integrate(ParticleStore &store, double time, Forces_ &&){
+                real h = real(time);
+                Integrators::Apply(store, time, [h](unsigned, unsigned, real &x, real &v, real acc, real drag){
+                    v = (v + acc * h) * drag;
+                    x += v * h;
+                });
+            }
+
+            void Finish(ParticleStore &, double){ }
+        };
+
+        /**
+         * Position Verlet. The velocity is not integrated; after the
+         * contacts are resolved it's worked out from how far the particle
+         * moved during the step. This way the position corrections of
+         * links such as rods and cables also correct the velocity, which
+         * keeps chains stable with fewer iterations. The impulses of the
+         * other contacts, including restitution, are kept, and their
+         * push-out doesn't turn into velocity.
+         */
+        struct PositionVerlet
+        {
+            template<class Forces_>
+            void Integrate(ParticleStore &store, double time, Forces_ &&){
+                store.SavePositions();
+
+                real h = real(time), timeSq = real(time * time);
+                Integrators::Apply(store, time, [h, timeSq](unsigned, unsigned, real &x, real &v, real acc, real drag){
+                    x += v * h * drag + acc * timeSq;
+
+                    // the distance moved over the time, kept for the
+                    // contacts that work on velocities
+                    v = v * drag + acc * h;
+                });
+
+                // record what the contacts do until Finish
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                {
+                    store.pushOut[a].assign(store.GetCount(), 0);
+                    store.linkMove[a].assign(store.GetCount(), 0);
+                    store.linkVelocity[a].assign(store.GetCount(), 0);
+                }
+            }
+
+            void Finish(ParticleStore &store, double time){
+                if(time > 0)
+                {
+                    // the moves of the links take the place of their
+                    // impulses, the push-out isn't a velocity
+                    unsigned count = std::min(store.GetCount(), (unsigned)store.linkMove[0].size());
+                    real h = real(time);
+                    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    {
+                        for(unsigned i = 0; i < count; i++)
+                        {
+                            if(!store.IsActive(i)) continue;
+                            store.velocity[a][i] += store.linkMove[a][i] / h - store.linkVelocity[a][i];
+                        }
+                    }
+                }
+
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                {
+                    store.pushOut[a].clear();
+                    store.linkMove[a].clear();
+                    store.linkVelocity[a].clear();
+                }
+            }
+        };
+
+        /**
+         * Second order Runge-Kutta (midpoint method). The forces are
+         * evaluated again at the middle of the step, so the force
+         * registry runs twice per step. Forces that are added to the
+         * particles outside of the registry only take part in the
+         * first evaluation.
+         */
+        struct MidpointRK2
+        {
+            template<class Forces_>
+            void Integrate(ParticleStore &store, double time, Forces_ &&forces){
+                store.SavePositions();
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    startVelocity[a].assign(store.velocity[a].begin(), store.velocity[a].end());
+
+                // move to the middle of the step
+                real half = time / 2;
+                Integrators::Apply(store, half, [half](unsigned, unsigned, real &x, real &v, real acc, real){
+                    x += v * half;
+                    v += acc * half;
+                });
+
+                forces();
+
+                // full step from the start using the middle derivatives
+                std::vector<real> (&x0)[ParticleStore::Axes] = store.previous;
+                real h = real(time);
+                Integrators::Apply(store, time, [&](unsigned i, unsigned a, real &x, real &v, real acc, real drag){
+                    x = x0[a][i] + v * h;
+                    v = (startVelocity[a][i] + acc * h) * drag;
+                });
+            }
+
+            void Finish(ParticleStore &, double){ }
+
+        protected:
+            std::vector<real> startVelocity[ParticleStore::Axes];
+        };
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * @file pislands.cpp is the implementation for pislands.h
+ */
+#include <Gorgon/Physics/pislands.h>
+#include <Gorgon/Physics/particle.h>
+#include <algorithm>
+#include <limits>
+
+using Gorgon::Physics::ParticleIslands;
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::ParticleSnapshot;
+using Gorgon::Physics::Particle;
+
+void ParticleIslands::Begin(const ParticleStore &store)
+{
+    this->store = &store;
+    unsigned count = store.GetCount();
+
+    parent.resize(count);
+    previous.resize(count, 0);
+    calmFrames.resize(count, 0);
+
+    for(unsigned i = 0; i < count; i++)
+        parent[i] = i;
+
+    // contacts between sleeping particles aren't generated,
+    // so their islands are carried over from the last frame
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(store.asleep[i] && previous[i] < count)
+        {
+            unsigned a = find(i), b = find(previous[i]);
+            if(a != b) parent[a] = b;
+        }
+    }
+}
+
+void ParticleIslands::Save(ParticleSnapshot &snapshot) const
+{
+    snapshot.Write((unsigned)previous.size());
+    snapshot.WriteArray(previous.data(), previous.size());
+    snapshot.WriteArray(calmFrames.data(), calmFrames.size());
+}
+
+void ParticleIslands::Restore(ParticleSnapshot::Reader &reader)
+{
+    unsigned count = reader.ReadLength(sizeof(unsigned) + sizeof(unsigned));
+    previous.resize(count);
+    calmFrames.resize(count);
+    reader.ReadArray(previous.data(), count);
+    reader.ReadArray(calmFrames.data(), count);
+}
+
+void ParticleIslands::Remap(const std::vector<unsigned> &remap, unsigned count)
+{
+    std::vector<unsigned> island(count), calm(count, 0);
+    for(unsigned i = 0; i < count; i++)
+        island[i] = i;
+
+    // an island whose representative is gone is represented by the
+    // first of its particles that's left
+    std::vector<unsigned> replaced(remap.size(), ParticleStore::NoIndex);
+
+    unsigned known = (unsigned)std::min(remap.size(), previous.size());
+    for(unsigned i = 0; i < known; i++)
+    {
+        unsigned to = remap[i];
+        if(to == ParticleStore::NoIndex) continue;
+
+        unsigned from = previous[i];
+        if(from < remap.size())
+        {
+            if(remap[from] != ParticleStore::NoIndex)
+            {
+                island[to] = remap[from];
+            }
+            else
+            {
+                if(replaced[from] == ParticleStore::NoIndex)
+                    replaced[from] = to;
+                island[to] = replaced[from];
+            }
+        }
+
+        calm[to] = calmFrames[i];
+    }
+
+    previous.swap(island);
+    calmFrames.swap(calm);
+}
+
+unsigned ParticleIslands::find(unsigned index)
+{
+    while(parent[index] != index)
+    {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+void ParticleIslands::Connect(const Particle *first, const Particle *second)
+{
+    if(first == nullptr || second == nullptr) return;
+    if(!first->IsIn(*store) || !second->IsIn(*store)) return;
+
+    Connect(*store, first->GetIndex(), second->GetIndex());
+}
+
+void ParticleIslands::Connect(const ParticleStore &store, unsigned first, unsigned second)
+{
+    if(&store != this->store) return;
+    if(first >= parent.size() || second >= parent.size()) return;
+
+    // particles with infinite mass don't join islands
+    if(store.inverseMass[first] <= 0 || store.inverseMass[second] <= 0) return;
+
+    unsigned a = find(first), b = find(second);
+    if(a != b) parent[a] = b;
+}
+
+void ParticleIslands::Update(ParticleStore &store)
+{
+    unsigned count = store.GetCount();
+
+    energy.assign(count, 0);
+    members.assign(count, 0);
+    minCalm.assign(count, std::numeric_limits<unsigned>::max());
+
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(store.inverseMass[i] <= 0 || store.views[i] == nullptr) continue;
+
+        real speedSq = 0;
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+            speedSq += store.velocity[a][i] * store.velocity[a][i];
+
+        unsigned island = find(i);
+        energy[island] += speedSq / (2 * store.inverseMass[i]);
+        members[island]++;
+        if(calmFrames[i] < minCalm[island])
+            minCalm[island] = calmFrames[i];
+    }
+
+    for(unsigned i = 0; i < count; i++)
+    {
+        unsigned island = find(i);
+        previous[i] = island;
+
+        if(store.inverseMass[i] <= 0 || store.views[i] == nullptr) continue;
+
+        bool calm = frames > 0 && energy[island] < threshold * members[island];
+        if(!calm)
+        {
+            calmFrames[i] = 0;
+            store.asleep[i] = 0;
+            continue;
+        }
+
+        // the island falls asleep as a whole, so each particle
+        // counts from the least calm particle of its island
+        calmFrames[i] = minCalm[island] + 1;
+        if(calmFrames[i] >= frames)
+        {
+            calmFrames[i] = frames;
+            if(!store.asleep[i])
+            {
+                store.asleep[i] = 1;
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    store.velocity[a][i] = 0;
+            }
+        }
+        else
+        {
+            store.asleep[i] = 0;
+        }
+    }
+}
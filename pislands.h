@@ -0,0 +1,110 @@
+/**
+ * @file pislands.h contains the ParticleIslands class
+ *
+ * @brief An island is a group of particles that are connected through
+ * links, constraints, contacts or forces that couple two particles such
+ * as springs. Islands are what the world puts to
+ * sleep: when the average kinetic energy of the particles of an island
+ * stays below a threshold for a number of frames, all of its particles
+ * fall asleep together. A sleeping island wakes up as a whole as soon
+ * as one of its particles is touched.
+ *
+ * Particles with infinite mass don't join islands; otherwise a single
+ * anchor would join everything attached to it into one island.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pstore.h>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ParticleIslands
+        {
+        public:
+            /**
+             * Islands whose average kinetic energy per particle is below
+             * this value are calm.
+             */
+            real threshold = 0;
+
+            /**
+             * Number of frames an island should stay calm to fall asleep.
+             * Zero disables sleeping.
+             */
+            unsigned frames = 0;
+
+            /**
+             * Starts building the islands of the given store. Sleeping
+             * particles stay in the islands they fell asleep in.
+             */
+            void Begin(const ParticleStore &store);
+
+            /**
+             * Joins the islands of the given particles. The particles
+             * should be in the store that's given to Begin; the second
+             * one can be null.
+             */
+            void Connect(const Particle *first, const Particle *second);
+
+            /**
+             * Joins the islands of the particles at the given indices of
+             * the given store. Nothing is joined if it's not the store
+             * that's given to Begin.
+             */
+            void Connect(const ParticleStore &store, unsigned first, unsigned second);
+
+            /**
+             * Works out which islands are calm, puts to sleep the ones
+             * that are calm long enough and wakes up the rest.
+             */
+            void Update(ParticleStore &store);
+
+            /**
+             * Writes and reads the sleeping state of the particles
+             */
+            void Save(ParticleSnapshot &snapshot) const;
+            void Restore(ParticleSnapshot::Reader &reader);
+
+            /**
+             * Moves the state of the particles to their new indices after
+             * the store is compacted or particles are removed. The remap
+             * holds the new index of each old one, or NoIndex for the
+             * removed particles, and count is the new number of slots.
+             */
+            void Remap(const std::vector<unsigned> &remap, unsigned count);
+
+            /**
+             * Returns the index of the particle that represents the
+             * island of the given particle, after the last Update.
+             */
+            inline unsigned GetIsland(unsigned index) const{
+                return previous[index];
+            };
+
+        protected:
+            unsigned find(unsigned index);
+
+            const ParticleStore *store = nullptr;
+
+            std::vector<unsigned> parent;
+
+            /**
+             * Holds the island of each particle from the last frame
+             */
+            std::vector<unsigned> previous;
+
+            /**
+             * Holds for how many frames each particle has been calm
+             */
+            std::vector<unsigned> calmFrames;
+
+            // per island totals, indexed by the representative particle
+            std::vector<real> energy;
+            std::vector<unsigned> members;
+            std::vector<unsigned> minCalm;
+        };
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * @file pjobs.cpp is the implementation for pjobs.h
+ */
+#include <Gorgon/Physics/pjobs.h>
+
+using Gorgon::Physics::ThreadPool;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if(threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if(threads == 0)
+        threads = 1;
+
+    // the calling thread is the first worker
+    for(unsigned i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start.notify_all();
+
+    for(std::thread &t : workers)
+        t.join();
+}
+
+void ThreadPool::Run(unsigned count, const Job &job)
+{
+    if(count == 0) return;
+
+    unsigned threads = GetThreadCount();
+
+    // not worth waking the workers up
+    if(threads == 1 || count == 1)
+    {
+        job(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &job;
+        this->count = count;
+        pending = threads - 1;
+        generation++;
+    }
+    start.notify_all();
+
+    job(0, count / threads, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{ return pending == 0; });
+    this->job = nullptr;
+}
+
+void ThreadPool::work(unsigned worker)
+{
+    unsigned long seen = 0;
+
+    while(true)
+    {
+        const Job *current;
+        unsigned total;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&]{ return quit || generation != seen; });
+            if(quit) return;
+
+            seen = generation;
+            current = job;
+            total = count;
+        }
+
+        unsigned threads = GetThreadCount();
+        unsigned begin = (unsigned)((unsigned long long)total * worker / threads);
+        unsigned end = (unsigned)((unsigned long long)total * (worker + 1) / threads);
+        if(begin < end)
+            (*current)(begin, end, worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending--;
+        }
+        done.notify_one();
+    }
+}
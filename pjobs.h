@@ -0,0 +1,74 @@
+/**
+ * @file pjobs.h contains the ThreadPool class
+ *
+ * @brief The thread pool runs the parallel stages of the engine. It keeps
+ * a fixed number of worker threads alive and splits a range of work into
+ * one contiguous chunk per thread. The chunks only depend on the range and
+ * the number of threads, so a stage that writes its results per chunk
+ * gives the same results every time for a given thread count.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ThreadPool
+        {
+        public:
+            /**
+             * A job processes the items in [begin, end). worker is the
+             * index of the chunk, between 0 and GetThreadCount() - 1.
+             */
+            typedef std::function<void(unsigned begin, unsigned end, unsigned worker)> Job;
+
+            /**
+             * Creates a pool with the given number of threads, including
+             * the calling thread. Zero uses one thread per hardware thread.
+             */
+            ThreadPool(unsigned threads = 0);
+
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool &operator=(const ThreadPool &) = delete;
+
+            inline unsigned GetThreadCount() const{
+                return (unsigned)workers.size() + 1;
+            };
+
+            /**
+             * Splits [0, count) into one chunk per thread and runs the
+             * job on each chunk. The calling thread runs the first chunk.
+             * Returns after all chunks are done.
+             */
+            void Run(unsigned count, const Job &job);
+
+        protected:
+            void work(unsigned worker);
+
+            std::vector<std::thread> workers;
+
+            std::mutex mutex;
+            std::condition_variable start, done;
+
+            const Job *job = nullptr;
+            unsigned count = 0;
+
+            /**
+             * Increases with each Run so the workers can tell a new
+             * job from the one they have already done
+             */
+            unsigned long generation = 0;
+
+            unsigned pending = 0;
+            bool quit = false;
+        };
+    }
+}
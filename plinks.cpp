@@ -3,7 +3,7 @@
 using Gorgon::Geometry::Point3D;
 using namespace Gorgon::Physics;
 
-double ParticleLinks::CurrentLength() const
+real ParticleLinks::CurrentLength() const
 {
     Point3D relativePos = particle[0]->GetPosition() 
                             -  particle[1]->GetPosition();
@@ -14,13 +14,14 @@ double ParticleLinks::CurrentLength() const
 unsigned CableLink::AddContact(ParticleContact *contact, unsigned limit) const
 {
     /// Get the current length
-    double length = CurrentLength();
+    real length = CurrentLength();
 
     /// Check if the cable is overextended
     if(length < maxLength) return 0;
 
     contact->particle[0] = particle[0];
     contact->particle[1] = particle[1];
+    contact->link = true;
 
     /// calculate the contact normal
     Point3D normal = particle[1]->GetPosition() - particle[0]->GetPosition();
@@ -36,13 +37,14 @@ unsigned CableLink::AddContact(ParticleContact *contact, unsigned limit) const
 unsigned RodLink::AddContact(ParticleContact *contact, unsigned limit) const
 {
     /// Get the current length of the rod
-    double currlength = CurrentLength();
+    real currlength = CurrentLength();
 
     /// Check if the cable is overextended
     if(currlength == length) return 0;
 
     contact->particle[0] = particle[0];
     contact->particle[1] = particle[1];
+    contact->link = true;
 
     /// Calculate the contact normal
     Point3D normal = particle[1]->GetPosition() - particle[0]->GetPosition();
@@ -63,7 +65,7 @@ unsigned RodLink::AddContact(ParticleContact *contact, unsigned limit) const
     return 1;
 }
 
-double Constraint::CurrentLength() const
+real Constraint::CurrentLength() const
 {
     Point3D relativePos = particle->GetPosition() - anchor;
     return relativePos.Distance();
@@ -74,7 +76,7 @@ unsigned CableConstraints::AddContact(ParticleContact *contact,
                 unsigned limit) const
 {
     /// Find the current length
-    double length = CurrentLength();
+    real length = CurrentLength();
 
     /// Check if we're over-extended or not
     if(length < maxLength) return 0;
@@ -82,12 +84,14 @@ unsigned CableConstraints::AddContact(ParticleContact *contact,
     /// Otherwise return the contact
     contact->particle[0] = particle;
     contact->particle[1] = 0;
+    contact->link = true;
 
     /// Calculate the contact normal (collision direction)
     Point3D normal = anchor - particle->GetPosition(); 
     normal.Normalize();
     contact->ContactNormal = normal;
 
+    contact->penetration = length - maxLength;
     contact->restitution = restitution;
     
     return 1;
@@ -98,7 +102,7 @@ unsigned RodConstraints::AddContact(ParticleContact *contact,
                                  unsigned limit) const
 {
     // Find the length of the rod
-    double currentLen = CurrentLength();
+    real currentLen = CurrentLength();
 
     // Check if we're over-extended
     if (currentLen == length) return 0;
@@ -106,6 +110,7 @@ unsigned RodConstraints::AddContact(ParticleContact *contact,
     // Otherwise return the contact
     contact->particle[0] = particle;
     contact->particle[1] = 0;
+    contact->link = true;
 
     // Calculate the normal
     Point3D normal = anchor - particle->GetPosition();
@@ -114,8 +119,10 @@ unsigned RodConstraints::AddContact(ParticleContact *contact,
     // The contact normal depends on whether we're extending or compressing
     if (currentLen > length) {
         contact->ContactNormal = normal;
+        contact->penetration = currentLen - length;
     } else {
         contact->ContactNormal = normal * -1;
+        contact->penetration = length - currentLen;
     }
 
     // Always use zero restitution (no bounciness)
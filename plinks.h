@@ -27,6 +27,12 @@ namespace Gorgon
              */
             Particle *particle[2];
 
+            /**
+             * Holds the compliance (inverse stiffness) of the link, used
+             * by the XPBD solver. Zero makes the link rigid.
+             */
+            real compliance = 0;
+
             /**
              * Fills the given contact structure with the contact needed
              * to keep the link from violating its constraint. The contact
@@ -43,12 +49,18 @@ namespace Gorgon
              */
 
             virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const = 0;
+
+            virtual unsigned GetConnected(Particle *(&particles)[2]) const{
+                particles[0] = particle[0];
+                particles[1] = particle[1];
+                return 2;
+            }
         
         protected:
             /**
              *  Returns the current length of the link
              */
-            inline double CurrentLength() const;
+            inline real CurrentLength() const;
         };
 
         /**
@@ -62,12 +74,12 @@ namespace Gorgon
             /**
              * Holds the maximum length of a cable
              */
-            double maxLength;
+            real maxLength;
 
             /**
              * Holds the restitution for the cable
              */
-            double restitution;
+            real restitution;
 
         public:
             /**
@@ -89,7 +101,7 @@ namespace Gorgon
             /**
              * Holds the length of the rod
              */
-            double length;
+            real length;
 
         public:
             /**
@@ -112,7 +124,7 @@ namespace Gorgon
             /**
              * Returns the current length of the link
              */
-            double CurrentLength() const;
+            real CurrentLength() const;
 
         public:
             /**
@@ -126,6 +138,12 @@ namespace Gorgon
             */
             Point3D anchor;
 
+            /**
+             * Holds the compliance (inverse stiffness) of the constraint,
+             * used by the XPBD solver. Zero makes the constraint rigid.
+             */
+            real compliance = 0;
+
             /**
                 * Fills the given contact structure with the generated
                 * contact. The contact pointer should point to the first
@@ -135,6 +153,11 @@ namespace Gorgon
                 * been written.
                 */
             virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const = 0;
+
+            virtual unsigned GetConnected(Particle *(&particles)[2]) const{
+                particles[0] = particle;
+                return 1;
+            }
         };
 
         /**
@@ -148,12 +171,12 @@ namespace Gorgon
             /**
              * Holds the maximum length of the cable.
              */
-            double maxLength;
+            real maxLength;
 
             /**
              * Holds the restitution (bounciness) of the cable.
              */
-            double restitution;
+            real restitution;
 
             /**
              * Fills the given contact structure with the contact needed
@@ -173,7 +196,7 @@ namespace Gorgon
             /**
              * Holds the fixed length of the rod
              */
-            double length;
+            real length;
 
             virtual unsigned AddContact(ParticleContact *contact,
                                          unsigned limit) const;
@@ -0,0 +1,26 @@
+/**
+ * @file preal.h contains the real number type of the engine
+ *
+ * @brief The state of the particles and the math over it use the real
+ * type, which is double unless GORGON_PHYSICS_FLOAT is defined. A float
+ * build halves the memory of the particle store and doubles the number
+ * of particles the SIMD kernels handle at once; the double build is
+ * meant for offline validation runs. Times, such as the durations of
+ * the frames and the clock of fixed stepping, are always double.
+ *
+ * Point3D is used in the interface of the engine regardless of the real
+ * type, and values are converted as they're passed in and out.
+ */
+#pragma once
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+#ifdef GORGON_PHYSICS_FLOAT
+        typedef float real;
+#else
+        typedef double real;
+#endif
+    }
+}
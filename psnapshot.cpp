@@ -0,0 +1,44 @@
+/**
+ * @file psnapshot.cpp is the implementation for psnapshot.h
+ */
+#include <Gorgon/Physics/psnapshot.h>
+
+using Gorgon::Physics::ParticleSnapshot;
+
+const unsigned ParticleSnapshot::Magic;
+const unsigned ParticleSnapshot::Version;
+
+namespace
+{
+    template<class From_>
+    void convert(const unsigned char *data, Gorgon::Physics::real *values, size_t count)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            From_ value;
+            memcpy(&value, data + i * sizeof(From_), sizeof(From_));
+            values[i] = (Gorgon::Physics::real)value;
+        }
+    }
+}
+
+void ParticleSnapshot::Reader::ReadReals(real *values, size_t count, unsigned realSize)
+{
+    if(realSize == sizeof(real))
+    {
+        ReadArray(values, count);
+    }
+    else if(realSize == sizeof(float) || realSize == sizeof(double))
+    {
+        check(count * realSize);
+        if(realSize == sizeof(float))
+            convert<float>(&snapshot.data[cursor], values, count);
+        else
+            convert<double>(&snapshot.data[cursor], values, count);
+        cursor += count * realSize;
+    }
+    else
+    {
+        throw std::runtime_error("snapshot has an unknown real number size");
+    }
+}
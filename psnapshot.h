@@ -0,0 +1,146 @@
+/**
+ * @file psnapshot.h contains the ParticleSnapshot class
+ *
+ * @brief A snapshot is a binary blob that holds the dynamic state of a
+ * particle world: the particle state, the parameters of the links, the
+ * sleeping state, the warm starting impulses (since version 2), the
+ * handles of the particles (since version 3) and the settings of the
+ * resolver and the stepping. It's used to roll a world
+ * back and simulate the frames again, so saving and restoring are mostly
+ * copies of the arrays of the store.
+ *
+ * The blob starts with a header that holds the version and the layout it
+ * was written with (number of axes and size of the real numbers). When
+ * the layout is the same as the reading engine's, the arrays are copied
+ * as they are; otherwise every number is converted.
+ *
+ * A snapshot only holds state, not structure: it can only be restored
+ * into the world it was saved from, or a world built the same way, with
+ * the same particles and contact generators.
+ */
+#pragma once
+
+#include <Gorgon/Physics/preal.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ParticleSnapshot
+        {
+        public:
+            /**
+             * Marks the start of a snapshot, "GPWS"
+             */
+            static const unsigned Magic = 0x53575047;
+
+            /**
+             * Version of the snapshot format that's written
+             */
+            static const unsigned Version = 3;
+
+            /**
+             * Reads a snapshot from its start
+             */
+            class Reader
+            {
+            public:
+                Reader(const ParticleSnapshot &snapshot)
+                : snapshot(snapshot)
+                { }
+
+                template<class T_>
+                T_ Read(){
+                    T_ value;
+                    ReadArray(&value, 1);
+                    return value;
+                }
+
+                template<class T_>
+                void ReadArray(T_ *values, size_t count){
+                    size_t size = count * sizeof(T_);
+                    check(size);
+                    if(size) memcpy(values, &snapshot.data[cursor], size);
+                    cursor += size;
+                }
+
+                /**
+                 * Reads real numbers that were written with the given
+                 * size, converting them if it's not the size of real
+                 */
+                void ReadReals(real *values, size_t count, unsigned realSize);
+
+                void Skip(size_t size){
+                    check(size);
+                    cursor += size;
+                }
+
+                inline bool AtEnd() const{
+                    return cursor == snapshot.data.size();
+                };
+
+                /**
+                 * Reads the length of a list whose items have the given
+                 * size, throws if the items can't fit in the rest of the
+                 * snapshot
+                 */
+                unsigned ReadLength(size_t itemSize){
+                    unsigned length = Read<unsigned>();
+                    check((size_t)length * itemSize);
+                    return length;
+                }
+
+            private:
+                void check(size_t size) const{
+                    if(cursor + size > snapshot.data.size())
+                        throw std::runtime_error("snapshot is truncated");
+                }
+
+                const ParticleSnapshot &snapshot;
+                size_t cursor = 0;
+            };
+
+            template<class T_>
+            void Write(const T_ &value){
+                WriteArray(&value, 1);
+            }
+
+            template<class T_>
+            void WriteArray(const T_ *values, size_t count){
+                size_t size = count * sizeof(T_);
+                size_t at = data.size();
+                data.resize(at + size);
+                if(size) memcpy(&data[at], values, size);
+            }
+
+            /**
+             * Empties the snapshot, keeping its memory
+             */
+            inline void Clear(){
+                data.clear();
+            };
+
+            /**
+             * Replaces the contents with the given blob, for instance
+             * one that's received from the network
+             */
+            inline void Assign(const void *blob, size_t size){
+                data.assign((const unsigned char*)blob, (const unsigned char*)blob + size);
+            };
+
+            inline const unsigned char *GetData() const{
+                return data.data();
+            };
+
+            inline size_t GetSize() const{
+                return data.size();
+            };
+
+        protected:
+            std::vector<unsigned char> data;
+        };
+    }
+}
@@ -0,0 +1,272 @@
+/**
+ * @file pstatic.cpp is the implementation for pstatic.h
+ */
+#include <Gorgon/Physics/pstatic.h>
+#include <Gorgon/Physics/particle.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using Gorgon::Geometry::Point3D;
+using namespace Gorgon::Physics;
+
+const unsigned StaticGeometry::Axes;
+const unsigned StaticGeometry::LeafSize;
+
+StaticGeometry::StaticGeometry(ParticleStore &store)
+: store(store)
+{
+}
+
+void StaticGeometry::AddHalfPlane(const Point3D &normal, real offset, real restitution)
+{
+    HalfPlane plane;
+    ParticleStore::ToArray(normal, plane.normal);
+
+    // keep the normal at unit length so the distances are right
+    real length = 0;
+    for(unsigned a = 0; a < Axes; a++)
+        length += plane.normal[a] * plane.normal[a];
+    length = std::sqrt(length);
+    if(length == 0) return;
+
+    for(unsigned a = 0; a < Axes; a++)
+        plane.normal[a] /= length;
+    plane.offset = offset / length;
+    plane.restitution = restitution;
+
+    planes.push_back(plane);
+}
+
+void StaticGeometry::AddSegment(const Point3D &start, const Point3D &end, real restitution, real thickness)
+{
+    Segment segment;
+    ParticleStore::ToArray(start, segment.start);
+    ParticleStore::ToArray(end, segment.end);
+    segment.thickness = thickness;
+    segment.restitution = restitution;
+
+    segments.push_back(segment);
+    dirty = true;
+}
+
+void StaticGeometry::AddPolyline(const std::vector<Point3D> &points, bool closed, real restitution, real thickness)
+{
+    if(points.size() < 2) return;
+
+    for(size_t i = 1; i < points.size(); i++)
+        AddSegment(points[i - 1], points[i], restitution, thickness);
+
+    if(closed && points.size() > 2)
+        AddSegment(points.back(), points.front(), restitution, thickness);
+}
+
+void StaticGeometry::Clear()
+{
+    planes.clear();
+    segments.clear();
+    nodes.clear();
+    order.clear();
+    dirty = false;
+}
+
+void StaticGeometry::Build()
+{
+    dirty = true;
+    update();
+}
+
+void StaticGeometry::update() const
+{
+    if(!dirty) return;
+    dirty = false;
+
+    nodes.clear();
+    order.resize(segments.size());
+    for(unsigned a = 0; a < Axes; a++)
+        center[a].resize(segments.size());
+
+    for(unsigned s = 0; s < segments.size(); s++)
+    {
+        order[s] = s;
+        for(unsigned a = 0; a < Axes; a++)
+            center[a][s] = (segments[s].start[a] + segments[s].end[a]) / 2;
+    }
+
+    if(!segments.empty())
+        build(0, (unsigned)segments.size());
+}
+
+unsigned StaticGeometry::build(unsigned begin, unsigned end) const
+{
+    unsigned index = (unsigned)nodes.size();
+    nodes.emplace_back();
+
+    // bounds of the segments, grown by their thickness
+    Node node;
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        node.min[a] = std::numeric_limits<real>::max();
+        node.max[a] = -std::numeric_limits<real>::max();
+    }
+
+    for(unsigned i = begin; i < end; i++)
+    {
+        const Segment &segment = segments[order[i]];
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            node.min[a] = std::min(node.min[a], std::min(segment.start[a], segment.end[a]) - segment.thickness);
+            node.max[a] = std::max(node.max[a], std::max(segment.start[a], segment.end[a]) + segment.thickness);
+        }
+    }
+
+    if(end - begin <= LeafSize)
+    {
+        node.first = begin;
+        node.count = end - begin;
+        nodes[index] = node;
+        return index;
+    }
+
+    // split at the median center along the longest axis
+    unsigned axis = 0;
+    for(unsigned a = 1; a < Axes; a++)
+        if(node.max[a] - node.min[a] > node.max[axis] - node.min[axis])
+            axis = a;
+
+    unsigned middle = begin + (end - begin) / 2;
+    const std::vector<real> &centers = center[axis];
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+        [&centers](unsigned l, unsigned r){
+            return centers[l] < centers[r];
+        }
+    );
+
+    build(begin, middle);
+    node.first = build(middle, end);
+    node.count = 0;
+    nodes[index] = node;
+
+    return index;
+}
+
+bool StaticGeometry::collide(unsigned particle, const Segment &segment, ParticleContact *contact) const
+{
+    // closest point of the segment to the particle
+    real edge[Axes], offset[Axes], lengthSq = 0, projection = 0;
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        edge[a] = segment.end[a] - segment.start[a];
+        offset[a] = store.position[a][particle] - segment.start[a];
+        lengthSq += edge[a] * edge[a];
+        projection += offset[a] * edge[a];
+    }
+
+    real t = lengthSq > 0 ? std::max(real(0), std::min(real(1), projection / lengthSq)) : 0;
+
+    real d[Axes], distSq = 0;
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        d[a] = offset[a] - edge[a] * t;
+        distSq += d[a] * d[a];
+    }
+
+    real reach = store.radius[particle] + segment.thickness;
+    if(distSq >= reach * reach) return false;
+
+    // the normal points from the segment to the particle; a particle on
+    // the segment is pushed to the left of it in the XY plane
+    real dist = std::sqrt(distSq);
+    Point3D normal(0, 1, 0);
+    if(dist > 0)
+    {
+        normal = ParticleStore::ToPoint(d) / dist;
+    }
+    else if(edge[0] != 0 || edge[1] != 0)
+    {
+        normal = Point3D(-edge[1], edge[0], 0);
+        normal.Normalize();
+    }
+
+    contact->particle[0] = store.views[particle];
+    contact->particle[1] = NULL;
+    contact->ContactNormal = normal;
+    contact->penetration = reach - dist;
+    contact->restitution = segment.restitution;
+
+    return true;
+}
+
+unsigned StaticGeometry::AddContact(ParticleContact *contact, unsigned limit) const
+{
+    update();
+
+    unsigned count = 0;
+    unsigned stack[64];
+
+    for(unsigned i = 0; i < store.GetCount(); i++)
+    {
+        if(store.views[i] == nullptr || !store.IsActive(i)) continue;
+
+        real radius = store.radius[i];
+
+        for(const HalfPlane &plane : planes)
+        {
+            real dist = -plane.offset;
+            for(unsigned a = 0; a < Axes; a++)
+                dist += plane.normal[a] * store.position[a][i];
+
+            if(dist >= radius) continue;
+
+            contact->particle[0] = store.views[i];
+            contact->particle[1] = NULL;
+            contact->ContactNormal = ParticleStore::ToPoint(plane.normal);
+            contact->penetration = radius - dist;
+            contact->restitution = plane.restitution;
+            contact->feature = unsigned(&plane - &planes[0]) + 1;
+            contact++;
+
+            if(++count >= limit) return count;
+        }
+
+        if(nodes.empty()) continue;
+
+        unsigned top = 0;
+        stack[top++] = 0;
+        while(top)
+        {
+            const Node &node = nodes[stack[--top]];
+
+            bool overlaps = true;
+            for(unsigned a = 0; a < Axes; a++)
+            {
+                real p = store.position[a][i];
+                if(p + radius < node.min[a] || p - radius > node.max[a])
+                {
+                    overlaps = false;
+                    break;
+                }
+            }
+            if(!overlaps) continue;
+
+            if(node.count == 0)
+            {
+                stack[top++] = node.first;
+                stack[top++] = unsigned(&node - &nodes[0]) + 1;
+                continue;
+            }
+
+            for(unsigned k = node.first; k < node.first + node.count; k++)
+            {
+                if(!collide(i, segments[order[k]], contact)) continue;
+
+                contact->feature = unsigned(planes.size() + order[k]) + 1;
+
+                contact++;
+                if(++count >= limit) return count;
+            }
+        }
+    }
+
+    return count;
+}
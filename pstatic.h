@@ -0,0 +1,155 @@
+/**
+ * @file pstatic.h contains the static geometry contact generator
+ *
+ * @brief Static geometry is the collision geometry of a level: half-planes
+ * such as the ground, and line segments and polylines for the walls and
+ * platforms. The segments are kept in a bounding volume hierarchy that's
+ * built once, so each particle is only tested against the few segments
+ * near it. Half-planes are unbounded, every particle is tested against
+ * each of them.
+ *
+ * Each surface has its own restitution. Contacts are generated between
+ * the particles and the geometry, so the second particle of each
+ * contact is null; the feature of the contact tells the surfaces apart.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pstore.h>
+#include <Gorgon/Physics/pcontacts.h>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class StaticGeometry : public ParticleContactGenerator
+        {
+        public:
+            /**
+             * Creates an empty geometry that collides with the particles
+             * of the given store
+             */
+            StaticGeometry(ParticleStore &store);
+
+            /**
+             * Adds a half-plane. The space behind the plane, where the
+             * dot product of the position and the normal is less than
+             * the offset, is solid.
+             */
+            void AddHalfPlane(const Point3D &normal, real offset, real restitution = 0.2);
+
+            /**
+             * Adds a segment. A particle touches the segment when its
+             * radius reaches the segment's thickness, so particles with
+             * no radius only collide with thick segments.
+             */
+            void AddSegment(const Point3D &start, const Point3D &end,
+                            real restitution = 0.2, real thickness = 0);
+
+            /**
+             * Adds a segment between each consecutive pair of points, and
+             * between the last and the first point if it's closed.
+             */
+            void AddPolyline(const std::vector<Point3D> &points, bool closed = false,
+                             real restitution = 0.2, real thickness = 0);
+
+            /**
+             * Removes all geometry
+             */
+            void Clear();
+
+            /**
+             * Builds the hierarchy of the segments. It's built on the
+             * first frame after the segments change if it's not called.
+             */
+            void Build();
+
+            inline unsigned GetHalfPlaneCount() const{
+                return (unsigned)planes.size();
+            };
+
+            inline unsigned GetSegmentCount() const{
+                return (unsigned)segments.size();
+            };
+
+            /**
+             * Fills the given contact array with the contacts of the
+             * particles that touch the geometry. Particles that are
+             * asleep or have infinite mass are not tested.
+             */
+            virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const;
+
+        protected:
+            static const unsigned Axes = ParticleStore::Axes;
+
+            /**
+             * Maximum number of segments in a leaf of the hierarchy
+             */
+            static const unsigned LeafSize = 4;
+
+            struct HalfPlane
+            {
+                real normal[Axes];
+                real offset;
+                real restitution;
+            };
+
+            struct Segment
+            {
+                real start[Axes];
+                real end[Axes];
+                real thickness;
+                real restitution;
+            };
+
+            /**
+             * A node of the hierarchy. A leaf holds count segments from
+             * first in the order array. The left child of an inner node
+             * is the next node and first is its right child.
+             */
+            struct Node
+            {
+                real min[Axes];
+                real max[Axes];
+                unsigned first;
+                unsigned count;
+            };
+
+            /**
+             * Builds the node for the segments in [begin, end) of the
+             * order array and returns its index
+             */
+            unsigned build(unsigned begin, unsigned end) const;
+
+            /**
+             * Rebuilds the hierarchy if the segments changed
+             */
+            void update() const;
+
+            /**
+             * Tests the particle against the segment and fills the
+             * contact if they touch. Returns whether a contact is written.
+             */
+            bool collide(unsigned particle, const Segment &segment, ParticleContact *contact) const;
+
+            ParticleStore &store;
+
+            std::vector<HalfPlane> planes;
+            std::vector<Segment> segments;
+
+            mutable std::vector<Node> nodes;
+
+            /**
+             * Segment indices in the order of the leaves
+             */
+            mutable std::vector<unsigned> order;
+
+            /**
+             * Holds the center of each segment while building
+             */
+            mutable std::vector<real> center[Axes];
+
+            mutable bool dirty = false;
+        };
+    }
+}
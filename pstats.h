@@ -0,0 +1,111 @@
+/**
+ * @file pstats.h contains the statistics of a particle world frame
+ *
+ * @brief When the engine is built with GORGON_PHYSICS_PROFILE defined,
+ * the particle world times each stage of RunPhysics and counts the work
+ * it does; the results of the last frame can be read with
+ * ParticleWorld::GetStats. Without the define the instrumentation is
+ * compiled out and the statistics stay zero.
+ */
+#pragma once
+
+#include <chrono>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        struct ParticleWorldStats
+        {
+            /**
+             * Time spent in each stage, in nanoseconds. Sleep is the
+             * time spent building the islands.
+             */
+            double forceTime = 0;
+            double integrateTime = 0;
+            double generateTime = 0;
+            double resolveTime = 0;
+            double sleepTime = 0;
+            double totalTime = 0;
+
+            /**
+             * Number of steps the frame is made of, more than one
+             * when ParticleWorld::Step runs substeps
+             */
+            unsigned steps = 0;
+
+            /**
+             * Number of particles that are integrated, sleeping and
+             * infinite mass particles are not counted
+             */
+            unsigned particlesIntegrated = 0;
+
+            unsigned contacts = 0;
+
+            /**
+             * Number of iterations the contact resolver used
+             */
+            unsigned iterationsUsed = 0;
+
+            /**
+             * Number of contacts generated by each type of generator
+             */
+            std::vector<std::pair<std::type_index, unsigned>> contactsPerType;
+
+            /**
+             * Resets the statistics for a new frame, keeping the memory
+             */
+            void Reset(){
+                forceTime = integrateTime = generateTime = resolveTime = sleepTime = totalTime = 0;
+                steps = particlesIntegrated = contacts = iterationsUsed = 0;
+                contactsPerType.clear();
+            }
+
+            /**
+             * Adds the given number of contacts to the count of a type
+             */
+            void AddContacts(const std::type_index &type, unsigned count){
+                for(auto &entry : contactsPerType)
+                {
+                    if(entry.first == type)
+                    {
+                        entry.second += count;
+                        return;
+                    }
+                }
+                contactsPerType.emplace_back(type, count);
+            }
+        };
+
+        /**
+         * Adds the time between its creation and destruction
+         * to the given statistic
+         */
+        class StageTimer
+        {
+        public:
+            StageTimer(double &target)
+            : target(target), start(std::chrono::steady_clock::now())
+            { }
+
+            ~StageTimer(){
+                target += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            }
+
+        private:
+            double &target;
+            std::chrono::steady_clock::time_point start;
+        };
+    }
+}
+
+#ifdef GORGON_PHYSICS_PROFILE
+#   define PHYSICS_STAGE_TIMER(stat) Gorgon::Physics::StageTimer stageTimer_##stat(stats.stat)
+#   define PHYSICS_STAT(expr) do { expr; } while(0)
+#else
+#   define PHYSICS_STAGE_TIMER(stat) do { } while(0)
+#   define PHYSICS_STAT(expr) do { } while(0)
+#endif
@@ -0,0 +1,505 @@
+/**
+ * @file pstore.cpp contains the implementation for the ParticleStore class
+ */
+#include <Gorgon/Physics/pstore.h>
+#include <Gorgon/Physics/particle.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using Gorgon::Physics::ParticleStore;
+using Gorgon::Physics::ParticleSnapshot;
+using Gorgon::Physics::real;
+
+const unsigned ParticleStore::Axes;
+const unsigned ParticleStore::NoIndex;
+
+void ParticleStore::newHandle(unsigned index)
+{
+    unsigned id;
+    if(!freeHandles.empty())
+    {
+        id = freeHandles.back();
+        freeHandles.pop_back();
+    }
+    else
+    {
+        id = (unsigned)handles.size();
+        handles.push_back({NoIndex, 0});
+    }
+
+    handles[id].index = index;
+    handleOf[index] = id;
+}
+
+void ParticleStore::releaseHandle(unsigned index)
+{
+    unsigned id = handleOf[index];
+    handles[id].index = NoIndex;
+    handles[id].generation++;
+    freeHandles.push_back(id);
+    handleOf[index] = NoIndex;
+}
+
+unsigned ParticleStore::Create()
+{
+    unsigned index;
+
+    // reuse a released slot if there's any
+    if(!freeSlots.empty())
+    {
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        index = GetCount();
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            position[a].push_back(0);
+            previous[a].push_back(0);
+            velocity[a].push_back(0);
+            acceleration[a].push_back(0);
+            forceAccum[a].push_back(0);
+        }
+        inverseMass.push_back(0);
+        damping.push_back(0);
+        radius.push_back(0);
+        asleep.push_back(0);
+        transient.push_back(0);
+        views.push_back(nullptr);
+        handleOf.push_back(NoIndex);
+    }
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a][index] = 0;
+        previous[a][index] = 0;
+        velocity[a][index] = 0;
+        acceleration[a][index] = 0;
+        forceAccum[a][index] = 0;
+    }
+    inverseMass[index] = 1;
+    damping[index] = 1;
+    radius[index] = 0;
+    asleep[index] = 0;
+    transient[index] = 0;
+    views[index] = nullptr;
+    newHandle(index);
+
+    return index;
+}
+
+void ParticleStore::releaseSlot(unsigned index)
+{
+    releaseHandle(index);
+
+    // zero inverse mass makes the integrator skip this slot
+    inverseMass[index] = 0;
+    asleep[index] = 0;
+    transient[index] = 0;
+    views[index] = nullptr;
+}
+
+void ParticleStore::Release(unsigned index)
+{
+    if(!IsLive(index)) return;
+
+    releaseSlot(index);
+    freeSlots.push_back(index);
+}
+
+void ParticleStore::Retire(unsigned index)
+{
+    if(!IsLive(index)) return;
+
+    releaseSlot(index);
+    retiredSlots.push_back(index);
+}
+
+void ParticleStore::Recycle()
+{
+    freeSlots.insert(freeSlots.end(), retiredSlots.begin(), retiredSlots.end());
+    retiredSlots.clear();
+}
+
+void ParticleStore::Reserve(unsigned count)
+{
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a].reserve(count);
+        previous[a].reserve(count);
+        velocity[a].reserve(count);
+        acceleration[a].reserve(count);
+        forceAccum[a].reserve(count);
+    }
+    inverseMass.reserve(count);
+    damping.reserve(count);
+    radius.reserve(count);
+    asleep.reserve(count);
+    transient.reserve(count);
+    views.reserve(count);
+    handleOf.reserve(count);
+}
+
+void ParticleStore::Clear()
+{
+    // the handles given out so far should stop working
+    for(unsigned i = 0; i < GetCount(); i++)
+        if(IsLive(i)) releaseHandle(i);
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a].clear();
+        previous[a].clear();
+        velocity[a].clear();
+        acceleration[a].clear();
+        forceAccum[a].clear();
+    }
+    inverseMass.clear();
+    damping.clear();
+    radius.clear();
+    asleep.clear();
+    transient.clear();
+    views.clear();
+    handleOf.clear();
+    freeSlots.clear();
+    retiredSlots.clear();
+}
+
+void ParticleStore::Compact(std::vector<unsigned> &remap)
+{
+    unsigned count = GetCount();
+    remap.assign(count, NoIndex);
+
+    // walking forwards keeps the order of the particles, a particle is
+    // only ever moved to a lower index
+    unsigned live = 0;
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(!IsLive(i)) continue;
+
+        remap[i] = live;
+        if(i != live)
+        {
+            for(unsigned a = 0; a < Axes; a++)
+            {
+                position[a][live] = position[a][i];
+                previous[a][live] = previous[a][i];
+                velocity[a][live] = velocity[a][i];
+                acceleration[a][live] = acceleration[a][i];
+                forceAccum[a][live] = forceAccum[a][i];
+            }
+            inverseMass[live] = inverseMass[i];
+            damping[live] = damping[i];
+            radius[live] = radius[i];
+            asleep[live] = asleep[i];
+            transient[live] = transient[i];
+            views[live] = views[i];
+            handleOf[live] = handleOf[i];
+
+            handles[handleOf[live]].index = live;
+            if(views[live] != nullptr)
+                views[live]->index = live;
+        }
+        live++;
+    }
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a].resize(live);
+        previous[a].resize(live);
+        velocity[a].resize(live);
+        acceleration[a].resize(live);
+        forceAccum[a].resize(live);
+    }
+    inverseMass.resize(live);
+    damping.resize(live);
+    radius.resize(live);
+    asleep.resize(live);
+    transient.resize(live);
+    views.resize(live);
+    handleOf.resize(live);
+    freeSlots.clear();
+    retiredSlots.clear();
+}
+
+void ParticleStore::SavePositions()
+{
+    for(unsigned a = 0; a < Axes; a++)
+        std::copy(position[a].begin(), position[a].end(), previous[a].begin());
+}
+
+void ParticleStore::Save(ParticleSnapshot &snapshot) const
+{
+    unsigned count = GetCount();
+    snapshot.Write(count);
+
+    // retired slots are restored as free ones
+    snapshot.Write((unsigned)(freeSlots.size() + retiredSlots.size()));
+    snapshot.WriteArray(freeSlots.data(), freeSlots.size());
+    snapshot.WriteArray(retiredSlots.data(), retiredSlots.size());
+
+    for(const std::vector<real> *field : {position, velocity, acceleration, previous, forceAccum})
+        for(unsigned a = 0; a < Axes; a++)
+            snapshot.WriteArray(field[a].data(), count);
+
+    snapshot.WriteArray(inverseMass.data(), count);
+    snapshot.WriteArray(damping.data(), count);
+    snapshot.WriteArray(radius.data(), count);
+    snapshot.WriteArray(asleep.data(), count);
+
+    snapshot.WriteArray(handleOf.data(), count);
+    snapshot.Write((unsigned)handles.size());
+    snapshot.WriteArray(handles.data(), handles.size());
+    snapshot.Write((unsigned)freeHandles.size());
+    snapshot.WriteArray(freeHandles.data(), freeHandles.size());
+}
+
+namespace
+{
+    void checkIndex(unsigned index, size_t count)
+    {
+        if(index >= count)
+            throw std::runtime_error("snapshot has an index out of range");
+    }
+}
+
+void ParticleStore::resize(unsigned count)
+{
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a].resize(count);
+        previous[a].resize(count);
+        velocity[a].resize(count);
+        acceleration[a].resize(count);
+        forceAccum[a].resize(count);
+    }
+    inverseMass.resize(count);
+    damping.resize(count);
+    radius.resize(count);
+    asleep.resize(count);
+    transient.assign(count, 0);
+    views.assign(count, nullptr);
+    handleOf.resize(count);
+}
+
+void ParticleStore::Restore(ParticleSnapshot::Reader &reader, unsigned version, unsigned axes, unsigned realSize, unsigned count)
+{
+    if(reader.Read<unsigned>() != count)
+        throw std::runtime_error("snapshot has a different number of particles");
+
+    resize(count);
+
+    freeSlots.resize(reader.ReadLength(sizeof(unsigned)));
+    reader.ReadArray(freeSlots.data(), freeSlots.size());
+    retiredSlots.clear();
+    for(unsigned index : freeSlots)
+        checkIndex(index, count);
+
+    for(std::vector<real> *field : {position, velocity, acceleration, previous, forceAccum})
+    {
+        for(unsigned a = 0; a < axes; a++)
+        {
+            if(a < Axes)
+                reader.ReadReals(field[a].data(), count, realSize);
+            else
+                reader.Skip((size_t)count * realSize);
+        }
+        for(unsigned a = axes; a < Axes; a++)
+            std::fill(field[a].begin(), field[a].end(), 0.0);
+    }
+
+    reader.ReadReals(inverseMass.data(), count, realSize);
+    reader.ReadReals(damping.data(), count, realSize);
+    reader.ReadReals(radius.data(), count, realSize);
+    reader.ReadArray(asleep.data(), count);
+
+    if(version >= 3)
+    {
+        reader.ReadArray(handleOf.data(), count);
+        handles.resize(reader.ReadLength(sizeof(HandleEntry)));
+        reader.ReadArray(handles.data(), handles.size());
+        freeHandles.resize(reader.ReadLength(sizeof(unsigned)));
+        reader.ReadArray(freeHandles.data(), freeHandles.size());
+
+        for(unsigned i = 0; i < count; i++)
+        {
+            if(handleOf[i] == NoIndex) continue;
+
+            checkIndex(handleOf[i], handles.size());
+            if(handles[handleOf[i]].index != i)
+                throw std::runtime_error("snapshot has an index out of range");
+        }
+        for(const HandleEntry &entry : handles)
+        {
+            if(entry.index != NoIndex)
+                checkIndex(entry.index, count);
+        }
+        for(unsigned id : freeHandles)
+            checkIndex(id, handles.size());
+    }
+    else
+    {
+        // older snapshots have no handles, Adopt keeps the ones of the
+        // live particles
+        handleOf.clear();
+        handles.clear();
+        freeHandles.clear();
+    }
+}
+
+void ParticleStore::Adopt(ParticleStore &restored)
+{
+    unsigned count = GetCount();
+    if(restored.GetCount() != count)
+        throw std::runtime_error("snapshot has a different number of particles");
+
+    // the transient slots keep their current state
+    for(unsigned i = 0; i < count; i++)
+    {
+        if(!transient[i]) continue;
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            restored.position[a][i] = position[a][i];
+            restored.previous[a][i] = previous[a][i];
+            restored.velocity[a][i] = velocity[a][i];
+            restored.acceleration[a][i] = acceleration[a][i];
+            restored.forceAccum[a][i] = forceAccum[a][i];
+        }
+        restored.inverseMass[i] = inverseMass[i];
+        restored.damping[i] = damping[i];
+        restored.radius[i] = radius[i];
+        restored.asleep[i] = asleep[i];
+    }
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        position[a].swap(restored.position[a]);
+        previous[a].swap(restored.previous[a]);
+        velocity[a].swap(restored.velocity[a]);
+        acceleration[a].swap(restored.acceleration[a]);
+        forceAccum[a].swap(restored.forceAccum[a]);
+    }
+    inverseMass.swap(restored.inverseMass);
+    damping.swap(restored.damping);
+    radius.swap(restored.radius);
+    asleep.swap(restored.asleep);
+    freeSlots.swap(restored.freeSlots);
+    retiredSlots.clear();
+
+    if(restored.handleOf.size() == count)
+    {
+        handleOf.swap(restored.handleOf);
+        handles.swap(restored.handles);
+        freeHandles.swap(restored.freeHandles);
+    }
+    else
+    {
+        std::vector<unsigned char> released(count, 0);
+        for(unsigned index : freeSlots)
+            released[index] = 1;
+
+        for(unsigned i = 0; i < count; i++)
+        {
+            if(released[i] && IsLive(i))
+                releaseHandle(i);
+            else if(!released[i] && !IsLive(i))
+                newHandle(i);
+        }
+    }
+}
+
+void ParticleStore::ClearAccumulators()
+{
+    for(unsigned a = 0; a < Axes; a++)
+        std::fill(forceAccum[a].begin(), forceAccum[a].end(), 0.0);
+}
+
+void ParticleStore::Integrate(double time)
+{
+    // abort the program if the time elapsed
+    // between frames is less than zero
+    if(time < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    unsigned count = GetCount();
+    real h = real(time);
+
+    // same steps as the single particle version below
+    for(unsigned i = 0; i < count; i++)
+    {
+        // don't integrate particles with zero mass or sleeping ones
+        if(!IsActive(i))
+            continue;
+
+        real drag = pow(damping[i], time);
+
+        for(unsigned a = 0; a < Axes; a++)
+        {
+            position[a][i] += velocity[a][i] * h;
+            velocity[a][i] += (acceleration[a][i] + forceAccum[a][i] * inverseMass[i]) * h;
+            velocity[a][i] *= drag;
+            forceAccum[a][i] = 0;
+        }
+    }
+}
+
+void ParticleStore::Integrate(unsigned index, double time)
+{
+    // don't integrate particles with zero mass or sleeping ones
+    if (!IsActive(index))
+        return;
+
+    // abort the program if the time elapsed
+    // between frames is less than zero
+    if(time < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    // impose drag by each frame instead of per intervals of time.
+    real drag = pow(damping[index], time);
+    real h = real(time);
+
+    for(unsigned a = 0; a < Axes; a++)
+    {
+        /**
+         * Update linear position
+         * we don't pay attiention to the accleration in the position update
+         * because the resulting acceleration would be very small due
+         * the smale time intervals so it wouldn't have impact,
+         * we will take it into consideration in the velocity update
+         */
+        position[a][index] += velocity[a][index] * h;
+
+        // work out the acceleration from the applied force
+        // add to the resulting acceleration force scaled with the inverse mass
+        real resultingAcceleration = acceleration[a][index] + forceAccum[a][index] * inverseMass[index];
+
+        // update the velocity and impose damping (drag)
+        velocity[a][index] += resultingAcceleration * h;
+        velocity[a][index] *= drag;
+
+        // clear the accumulated forces
+        forceAccum[a][index] = 0;
+    }
+}
+
+ParticleStore &ParticleStore::Detached()
+{
+    // the store outlives the thread if particles are still in it,
+    // otherwise their destructors would release into a dead store
+    struct Holder
+    {
+        ParticleStore *store = new ParticleStore();
+
+        ~Holder(){
+            if(store->GetLiveCount() == 0)
+                delete store;
+        }
+    };
+
+    static thread_local Holder holder;
+    return *holder.store;
+}
@@ -0,0 +1,436 @@
+/**
+ * @file pstore.h contains the ParticleStore class
+ *
+ * @brief The particle store keeps the state of many particles in
+ * structure-of-arrays form. Each property of the particles (position,
+ * velocity, acceleration, accumulated force, inverse mass and damping)
+ * is stored in its own contiguous array, and every vector property is
+ * split into one array per axis. This way the loops that touch every
+ * particle every frame (clearing the accumulators and the integration)
+ * walk memory linearly instead of chasing a pointer per particle.
+ *
+ * Particles inside a store are addressed by their index. The Particle
+ * class is a light view (store + index) over a slot in a store. Slots
+ * are handed out and released in constant time, and a store can be
+ * compacted to move the live particles to the front, which changes
+ * their indices. Code that needs to refer to a particle across
+ * compactions and removals keeps a ParticleHandle instead of an index.
+ *
+ * When GORGON_PHYSICS_2D is defined the store only has the X and Y
+ * axes. The Z components of the points given to the store are dropped
+ * and the points it returns have zero Z, and every loop over the axes
+ * does a third less work. The definition changes the layout of the
+ * public classes, so the whole program has to be built with or without
+ * it; dir.cmake defines it for the build.
+ */
+#pragma once
+
+#include <Gorgon/Geometry/Point3D.h>
+#include <Gorgon/Physics/preal.h>
+#include <Gorgon/Physics/psnapshot.h>
+#include <vector>
+
+using Gorgon::Geometry::Point3D;
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class Particle;
+
+        /**
+         * Refers to a particle of a store for as long as it lives. The
+         * handle keeps referring to the same particle when the store is
+         * compacted, and refers to nothing once the particle is released,
+         * even after its slot is handed out again.
+         */
+        struct ParticleHandle
+        {
+            /**
+             * Entry in the handle table of the store
+             */
+            unsigned id = (unsigned)-1;
+
+            /**
+             * Number of times the entry was released before this handle
+             * was handed out
+             */
+            unsigned generation = 0;
+
+            inline bool operator==(const ParticleHandle &other) const{
+                return id == other.id && generation == other.generation;
+            };
+            inline bool operator!=(const ParticleHandle &other) const{
+                return !(*this == other);
+            };
+        };
+
+        class ParticleStore
+        {
+        public:
+            /**
+             * Marks an index that doesn't refer to a slot
+             */
+            static const unsigned NoIndex = (unsigned)-1;
+
+            /**
+             * Number of axes each vector property is split into.
+             */
+#ifdef GORGON_PHYSICS_2D
+            static const unsigned Axes = 2;
+#else
+            static const unsigned Axes = 3;
+#endif
+
+            /**
+             * Kinematic state of the particles, one array per axis.
+             * All arrays have the same length which is GetCount().
+             */
+            std::vector<real> position[Axes];
+            std::vector<real> velocity[Axes];
+            std::vector<real> acceleration[Axes];
+
+            /**
+             * Holds the positions at the start of the last step, used
+             * to interpolate the positions between two steps.
+             */
+            std::vector<real> previous[Axes];
+
+            /**
+             * Holds the accumulated force that to be applied in the
+             * next frame update. It's cleared by each frame.
+             */
+            std::vector<real> forceAccum[Axes];
+
+            /**
+             * Hold how far the contacts that are not links pushed the
+             * particles apart, how far the links moved them and how much
+             * the links changed their velocities during the current step.
+             * Integrators that work the velocity out of the positions,
+             * see PositionVerlet, fill them with zeros to record these;
+             * they are empty otherwise.
+             */
+            std::vector<real> pushOut[Axes];
+            std::vector<real> linkMove[Axes];
+            std::vector<real> linkVelocity[Axes];
+
+            std::vector<real> inverseMass;
+            std::vector<real> damping;
+
+            /**
+             * Holds the collision radius of the particles. Particles
+             * with zero radius don't collide with each other.
+             */
+            std::vector<real> radius;
+
+            /**
+             * Holds whether the particles are asleep. Sleeping particles
+             * are not integrated and don't receive forces from the
+             * registry until they are woken up.
+             */
+            std::vector<unsigned char> asleep;
+
+            /**
+             * Holds whether the slots are left out of the snapshots, such
+             * as the ones of emitters. Restore keeps the current state of
+             * these slots.
+             */
+            std::vector<unsigned char> transient;
+
+            /**
+             * Holds the particle object of each slot. Contact generators
+             * that work on indices use it to fill the contacts. It's null
+             * for the slots that no particle object refers to.
+             */
+            std::vector<Particle*> views;
+
+            /**
+             * Creates a new particle slot and returns its index. A new
+             * particle is at rest at the origin, has unit mass, no
+             * damping and no collision radius. Released slots are
+             * reused before the arrays grow.
+             */
+            unsigned Create();
+
+            /**
+             * Releases the slot at the given index. The slot will not be
+             * integrated until it's handed out again by Create, and the
+             * handle of the particle stops referring to it. Releasing a
+             * released slot does nothing.
+             */
+            void Release(unsigned index);
+
+            /**
+             * Releases the slot like Release, but the slot isn't handed
+             * out again until Recycle is called. This way a particle can
+             * be removed while other objects still refer to its slot.
+             */
+            void Retire(unsigned index);
+
+            /**
+             * Makes the retired slots available to Create
+             */
+            void Recycle();
+
+            /**
+             * Moves the live particles to the front of the arrays, keeping
+             * their order, and drops the released slots. The new index of
+             * each old slot, or NoIndex for the released ones, is written
+             * to remap. The particle objects and the handles are updated;
+             * anything else that keeps indices should be remapped.
+             */
+            void Compact(std::vector<unsigned> &remap);
+
+            /**
+             * Returns the handle of the particle at the given index
+             */
+            inline ParticleHandle GetHandle(unsigned index) const{
+                ParticleHandle handle;
+                handle.id = handleOf[index];
+                if(handle.id != NoIndex)
+                    handle.generation = handles[handle.id].generation;
+                return handle;
+            };
+
+            /**
+             * Returns the index of the particle the handle refers to, or
+             * NoIndex if it's released
+             */
+            inline unsigned Find(ParticleHandle handle) const{
+                if(handle.id >= handles.size() || handles[handle.id].generation != handle.generation)
+                    return NoIndex;
+                return handles[handle.id].index;
+            };
+
+            inline bool IsValid(ParticleHandle handle) const{
+                return Find(handle) != NoIndex;
+            };
+
+            /**
+             * Returns whether the slot at the given index holds a particle
+             */
+            inline bool IsLive(unsigned index) const{
+                return handleOf[index] != NoIndex;
+            };
+
+            /**
+             * Returns the number of slots that hold a particle
+             */
+            inline unsigned GetLiveCount() const{
+                return GetCount() - (unsigned)(freeSlots.size() + retiredSlots.size());
+            };
+
+            /**
+             * Reserves memory for the given number of particles.
+             */
+            void Reserve(unsigned count);
+
+            /**
+             * Removes all particles from the store
+             */
+            void Clear();
+
+            /**
+             * Returns the number of slots in the store, including
+             * the released ones.
+             */
+            inline unsigned GetCount() const{
+                return (unsigned)inverseMass.size();
+            };
+
+            /**
+             * Clears the force accumulators of all particles.
+             */
+            void ClearAccumulators();
+
+            /**
+             * Integrates all particles in the store forward in time
+             * by the given duration.
+             */
+            void Integrate(double time);
+
+            /**
+             * Integrates a single particle forward in time by the given duration.
+             */
+            void Integrate(unsigned index, double time);
+
+            inline Point3D GetPosition(unsigned index) const{
+                return get(position, index);
+            };
+            inline void SetPosition(unsigned index, const Point3D &value){
+                set(position, index, value);
+            };
+
+            /**
+             * Returns the position between the start and the end of the
+             * last step. Alpha 0 is the start and 1 is the end.
+             */
+            inline Point3D GetInterpolatedPosition(unsigned index, double alpha) const{
+                real p[Axes];
+                for(unsigned a = 0; a < Axes; a++)
+                    p[a] = previous[a][index] + (position[a][index] - previous[a][index]) * alpha;
+                return ToPoint(p);
+            };
+
+            /**
+             * Saves the current positions as the start of the next step
+             */
+            void SavePositions();
+
+            inline Point3D GetVelocity(unsigned index) const{
+                return get(velocity, index);
+            };
+            inline void SetVelocity(unsigned index, const Point3D &value){
+                set(velocity, index, value);
+            };
+
+            inline Point3D GetAcceleration(unsigned index) const{
+                return get(acceleration, index);
+            };
+            inline void SetAcceleration(unsigned index, const Point3D &value){
+                set(acceleration, index, value);
+            };
+
+            inline Point3D GetForceAccum(unsigned index) const{
+                return get(forceAccum, index);
+            };
+            inline void ClearAccumulator(unsigned index){
+                for(unsigned a = 0; a < Axes; a++)
+                    forceAccum[a][index] = 0;
+            };
+            inline void AddForce(unsigned index, const Point3D &force){
+                real f[Axes];
+                ToArray(force, f);
+                for(unsigned a = 0; a < Axes; a++)
+                    forceAccum[a][index] += f[a];
+            };
+
+            /**
+             * Returns whether the particle at the given index should be
+             * integrated
+             */
+            inline bool IsActive(unsigned index) const{
+                return inverseMass[index] > 0 && !asleep[index];
+            };
+
+            /**
+             * Converts a point to the values of the axes of the store,
+             * dropping Z in the 2D build
+             */
+            static inline void ToArray(const Point3D &point, real *values){
+                values[0] = point.X;
+                values[1] = point.Y;
+                if(Axes > 2) values[Axes - 1] = point.Z;
+            };
+
+            /**
+             * Converts the values of the axes of the store to a point
+             */
+            static inline Point3D ToPoint(const real *values){
+                return Point3D(values[0], values[1], Axes > 2 ? values[Axes - 1] : 0);
+            };
+
+            /**
+             * Writes the state of all slots to the snapshot
+             */
+            void Save(ParticleSnapshot &snapshot) const;
+
+            /**
+             * Reads the state written by Save into this store, which is
+             * used for staging. The snapshot is written with the given
+             * version, number of axes and size of real numbers; missing
+             * axes are zeroed and extra ones are skipped. It must have the
+             * given number of slots, since the particle objects can't be
+             * recreated. The slots have no particle objects until the
+             * state is moved to a store that has them with Adopt. Throws
+             * if the snapshot is malformed.
+             */
+            void Restore(ParticleSnapshot::Reader &reader, unsigned version, unsigned axes, unsigned realSize, unsigned count);
+
+            /**
+             * Takes the state of the slots from a store that's restored
+             * from a snapshot, keeping the particle objects of this store
+             * and the current state of its transient slots. Both stores
+             * must have the same number of slots; the other one is left
+             * with the old state.
+             */
+            void Adopt(ParticleStore &restored);
+
+            /**
+             * Returns the store that holds the particles that are
+             * created on their own, outside of any world. Each thread
+             * has its own detached store, so a detached particle should
+             * be used on the thread that created it until it's attached
+             * to a world.
+             */
+            static ParticleStore &Detached();
+
+        protected:
+            /**
+             * Slots that are released and can be handed out again
+             */
+            std::vector<unsigned> freeSlots;
+
+            /**
+             * Slots that are released but can't be handed out until
+             * Recycle is called
+             */
+            std::vector<unsigned> retiredSlots;
+
+            /**
+             * Empties the slot at the given index and releases its handle
+             */
+            void releaseSlot(unsigned index);
+
+            /**
+             * An entry of the handle table: the slot of the particle and
+             * how many times the entry was released
+             */
+            struct HandleEntry
+            {
+                unsigned index;
+                unsigned generation;
+            };
+
+            std::vector<HandleEntry> handles;
+
+            /**
+             * Entries of the handle table that are free
+             */
+            std::vector<unsigned> freeHandles;
+
+            /**
+             * Holds the handle table entry of each slot, NoIndex for the
+             * released slots
+             */
+            std::vector<unsigned> handleOf;
+
+            /**
+             * Gives the slot at the given index a new handle
+             */
+            void newHandle(unsigned index);
+
+            /**
+             * Releases the handle of the slot at the given index
+             */
+            void releaseHandle(unsigned index);
+
+            /**
+             * Resizes the arrays of the slots to the given count
+             */
+            void resize(unsigned count);
+
+            static inline Point3D get(const std::vector<real> (&arr)[Axes], unsigned index){
+                real values[Axes];
+                for(unsigned a = 0; a < Axes; a++)
+                    values[a] = arr[a][index];
+                return ToPoint(values);
+            };
+            static inline void set(std::vector<real> (&arr)[Axes], unsigned index, const Point3D &value){
+                real values[Axes];
+                ToArray(value, values);
+                for(unsigned a = 0; a < Axes; a++)
+                    arr[a][index] = values[a];
+            };
+        };
+    }
+}
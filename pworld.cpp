@@ -1,26 +1,185 @@
 #include "pworld.h"
+#include "plinks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <typeinfo>
 
 using namespace Gorgon::Physics;
 using namespace Gorgon::Containers;
 ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations)
 : resolver(iterations), 
-maxContacts(maxContacts)
+contacts(maxContacts)
 {
-    contacts = new ParticleContact[maxContacts];
     calculateIterations = (iterations == 0);
 }
 
 ParticleWorld::~ParticleWorld()
 {
-    delete[] contacts;
+    ownedParticles.Destroy();
+
+    for(Particle *particle : particlePool)
+        delete particle;
 }
 
-void ParticleWorld::StartFrame()
+Particle &ParticleWorld::AddParticle()
 {
-    
+    syncParticles();
+
+    Particle *particle;
+    if(!particlePool.empty())
+    {
+        particle = particlePool.back();
+        particlePool.pop_back();
+        *particle = Particle(store, store.Create());
+    }
+    else
+    {
+        particle = new Particle(store, store.Create());
+    }
+    store.views[particle->GetIndex()] = particle;
+    ownedParticles.Add(particle);
+    particles.Add(particle);
+    linksChanged = true;
+
+    return *particle;
+}
+
+void ParticleWorld::AddParticle(Particle &particle)
+{
+    syncParticles();
+
+    particle.Attach(store);
+    particles.Add(particle);
+    linksChanged = true;
+}
+
+void ParticleWorld::RemoveParticle(Particle &particle)
+{
+    syncParticles();
+
+    if(!particle.IsIn(store) || !store.IsLive(particle.GetIndex())) return;
+
+    // the slot is retired so that it isn't handed out again while
+    // the springs and the islands still refer to it
+    store.Retire(particle.GetIndex());
+    removedParticles.push_back(&particle);
+}
+
+void ParticleWorld::Compact()
+{
+    flushRemoved();
+
+    store.Compact(remap);
+    registry.Remap(store, remap);
+    islands.Remap(remap, store.GetCount());
+
+    for(ParticleContactGenerator &gen : contactGens)
+        gen.Remap(store, remap);
+
+    linksChanged = true;
+}
+
+void ParticleWorld::syncParticles()
+{
+    if(!particlesChanged) return;
+
     for(Particle &p : particles){
-        p.ClearAccumulator();
+        p.Attach(store);
+    }
+    particlesChanged = false;
+    linksChanged = true;
+}
+
+void ParticleWorld::flushRemoved()
+{
+    if(removedParticles.empty()) return;
+
+    syncParticles();
+
+    std::sort(removedParticles.begin(), removedParticles.end());
+    auto removed = [this](const Particle *particle){
+        return particle != nullptr &&
+            std::binary_search(removedParticles.begin(), removedParticles.end(), particle);
+    };
+
+    // the collections are rebuilt in a single pass instead of
+    // searching for each removed particle
+    std::vector<Particle*> kept;
+    for(Particle &p : particles)
+        if(!removed(&p)) kept.push_back(&p);
+
+    particles.Clear();
+    for(Particle *p : kept)
+        particles.Add(p);
+
+    kept.clear();
+    for(Particle &p : ownedParticles)
+    {
+        if(removed(&p))
+            particlePool.push_back(&p);
+        else
+            kept.push_back(&p);
+    }
+
+    ownedParticles.Clear();
+    for(Particle *p : kept)
+        ownedParticles.Add(p);
+
+    registry.RemoveIf([&removed](const Particle *particle, const ParticleForceGenerator *fg){
+        return removed(particle) || removed(fg->GetOther());
+    });
+
+    // links that connect a removed particle are dropped
+    std::vector<ParticleContactGenerator*> gens;
+    for(ParticleContactGenerator &gen : contactGens)
+    {
+        Particle *connected[2] = {nullptr, nullptr};
+        unsigned numConnected = gen.GetConnected(connected);
+
+        bool drop = false;
+        for(unsigned i = 0; i < numConnected; i++)
+            drop = drop || removed(connected[i]);
+
+        if(!drop) gens.push_back(&gen);
+    }
+
+    if(gens.size() != (size_t)contactGens.GetCount())
+    {
+        contactGens.Clear();
+        for(ParticleContactGenerator *gen : gens)
+            contactGens.Add(gen);
     }
+
+    contactCache.RemoveIf([&removed](const Particle *first, const Particle *second){
+        return removed(first) || removed(second);
+    });
+
+    // the slots don't move, only the removed ones are dropped
+    remap.resize(store.GetCount());
+    for(unsigned i = 0; i < store.GetCount(); i++)
+        remap[i] = i;
+    for(Particle *p : removedParticles)
+        remap[p->GetIndex()] = ParticleStore::NoIndex;
+
+    registry.Remap(store, remap);
+    islands.Remap(remap, store.GetCount());
+
+    for(ParticleContactGenerator &gen : contactGens)
+        gen.Remap(store, remap);
+
+    store.Recycle();
+    removedParticles.clear();
+    linksChanged = true;
+}
+
+void ParticleWorld::StartFrame()
+{
+    flushRemoved();
+    syncParticles();
+
+    store.ClearAccumulators();
     
     /// Loop over all particles in the world
 //     for(Particles::iterator itr = particles.begin(); 
@@ -32,16 +191,67 @@ void ParticleWorld::StartFrame()
 //     }
 }
 
+void ParticleWorld::classifyGenerators()
+{
+    // the collection is given out by GetContactGens, so a change is
+    // found by comparing the generators, which needs no casts
+    if(!linksChanged && classifiedGens.size() == (size_t)contactGens.GetCount())
+    {
+        unsigned i = 0;
+        for(ParticleContactGenerator &gen : contactGens)
+        {
+            if(classifiedGens[i] != &gen) break;
+            i++;
+        }
+
+        if(i == classifiedGens.size()) return;
+    }
+
+    classifiedGens.clear();
+    xpbdGens.clear();
+    xpbd.Clear();
+    for(ParticleContactGenerator &gen : contactGens)
+    {
+        classifiedGens.push_back(&gen);
+        xpbdGens.push_back(ParticleXPBD::Handles(gen));
+        xpbd.Add(gen, store);
+    }
+
+    linksChanged = false;
+}
+
+bool ParticleWorld::skipGenerator(unsigned index) const
+{
+    // links are solved by the XPBD solver
+    if(linkSolver == LinkSolver::XPBD && xpbdGens[index]) return true;
+
+    // skip the generators whose particles are all asleep
+    Particle *connected[2];
+    unsigned numConnected = classifiedGens[index]->GetConnected(connected);
+    if(numConnected == 0) return false;
+
+    for(unsigned i = 0; i < numConnected; i++)
+        if(connected[i] != nullptr && connected[i]->IsAwake()) return false;
+
+    return true;
+}
+
 unsigned ParticleWorld::GenerateContacts()
 {
-    unsigned limit = maxContacts;
-    ParticleContact *nextContact = contacts;
+    contacts.Reset();
+
+    classifyGenerators();
+
+    if(pool && parallelContacts)
+        return generateParallel();
     
-    for(ParticleContactGenerator &gen : contactGens){
-        unsigned used = gen.AddContact(nextContact, limit);
-        limit -= used;
-        nextContact += used;
-        if (limit<=0) break;
+    for(unsigned i = 0; i < classifiedGens.size(); i++){
+        if(skipGenerator(i)) continue;
+
+        ParticleContactGenerator &gen = *classifiedGens[i];
+        unsigned used = contacts.Generate(gen);
+        PHYSICS_STAT(stats.AddContacts(typeid(gen), used));
+        (void)used;
     }
         
     
@@ -58,15 +268,50 @@ unsigned ParticleWorld::GenerateContacts()
 //     }
 
     /// Returns the number of contacts used
-    return maxContacts - limit;
+    return contacts.GetUsed();
 }
 
-void ParticleWorld::Integrate(unsigned time)
+unsigned ParticleWorld::generateParallel()
 {
-    
-    for(Particle &p : particles){
-        p.Integrator(time);
+    activeGens.clear();
+    for(unsigned i = 0; i < classifiedGens.size(); i++){
+        if(!skipGenerator(i))
+            activeGens.push_back(classifiedGens[i]);
+    }
+
+    unsigned threads = pool->GetThreadCount();
+    while(workerContacts.size() < threads)
+        workerContacts.emplace_back(64);
+    genContacts.resize(activeGens.size());
+
+    // each worker runs a contiguous range of the generators into its own
+    // arena, so appending the arenas in worker order gives the same
+    // contacts in the same order as running the generators one by one
+    pool->Run((unsigned)activeGens.size(), [this](unsigned begin, unsigned end, unsigned worker){
+        ParticleContactArena &arena = workerContacts[worker];
+        arena.Reset();
+
+        for(unsigned i = begin; i < end; i++)
+            genContacts[i] = arena.Generate(*activeGens[i]);
+    });
+
+    for(unsigned i = 0; i < activeGens.size(); i++)
+        PHYSICS_STAT(stats.AddContacts(typeid(*activeGens[i]), genContacts[i]));
+
+    for(unsigned w = 0; w < threads; w++)
+    {
+        contacts.Append(workerContacts[w]);
+        workerContacts[w].Reset();
     }
+
+    return contacts.GetUsed();
+}
+
+void ParticleWorld::Integrate(double time)
+{
+    syncParticles();
+
+    integrator.Integrate(store, time);
     
     /*for(Particles::iterator itr = particles.begin();
         itr != particles.end();
@@ -76,25 +321,428 @@ void ParticleWorld::Integrate(unsigned time)
     }*/
 }
 
-void ParticleWorld::RunPhysics(unsigned time)
+void ParticleWorld::RunPhysics(double time)
 {
+    // Step collects the statistics of all of its substeps
+    if(!stepping)
+        PHYSICS_STAT(stats.Reset());
+
+    flushRemoved();
+
+    PHYSICS_STAGE_TIMER(totalTime);
+    PHYSICS_STAT(stats.steps++);
+
     /// First apply the forces generators
-    registry.UpdateForces(time);
+    {
+        PHYSICS_STAGE_TIMER(forceTime);
+        registry.Update(time);
+        registry.UpdateForces(time);
+    }
 
     /// Then integrate the object
-    Integrate(time);
+    {
+        PHYSICS_STAGE_TIMER(integrateTime);
+        syncParticles();
+        PHYSICS_STAT(
+            for(unsigned i = 0; i < store.GetCount(); i++)
+                stats.particlesIntegrated += store.IsActive(i)
+        );
+
+        if(linkSolver == LinkSolver::XPBD)
+            solveLinks(time);
+        else
+            Integrate(time);
+    }
 
     /// Generate contacts
-    unsigned usedContacts = GenerateContacts();
+    unsigned usedContacts;
+    {
+        PHYSICS_STAGE_TIMER(generateTime);
+        usedContacts = GenerateContacts();
+        PHYSICS_STAT(stats.contacts += usedContacts);
+    }
 
     /// Process these contacts
-    if(usedContacts)
     {
-        if(calculateIterations)
+        PHYSICS_STAGE_TIMER(resolveTime);
+        if(warmStarting)
+            contactCache.WarmStart(contacts.GetContacts(), usedContacts);
+
+        if(usedContacts)
         {
-            resolver.SetIterations(usedContacts * 2);
+            if(calculateIterations)
+            {
+                resolver.SetIterations(usedContacts * 2);
+            }
+            resolver.ResolveContacts(contacts.GetContacts(), usedContacts, time);
+            PHYSICS_STAT(stats.iterationsUsed += resolver.GetIterationsUsed());
+        }
+
+        if(warmStarting)
+            contactCache.Store(contacts.GetContacts(), usedContacts);
+
+        if(linkSolver != LinkSolver::XPBD)
+            finishIntegration(time);
+    }
+
+    if(islands.frames)
+    {
+        PHYSICS_STAGE_TIMER(sleepTime);
+        updateIslands(usedContacts);
+    }
+}
+
+void ParticleWorld::solveLinks(double time)
+{
+    syncParticles();
+    classifyGenerators();
+
+    xpbd.Refresh();
+    xpbd.Step(store, time);
+}
+
+unsigned ParticleWorld::Step(double elapsed)
+{
+    if(elapsed < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    // without a fixed step, the whole elapsed time is a single step
+    if(fixedStep <= 0)
+    {
+        stepping = false;
+        syncParticles();
+        store.SavePositions();
+        RunPhysics(elapsed);
+        return 1;
+    }
+
+    PHYSICS_STAT(stats.Reset());
+    stepping = true;
+
+    accumulator += elapsed;
+
+    unsigned steps = 0;
+    while(accumulator >= fixedStep && steps < maxSubsteps)
+    {
+        syncParticles();
+        store.SavePositions();
+
+        RunPhysics(fixedStep);
+
+        accumulator -= fixedStep;
+        steps++;
+    }
+    stepping = false;
+
+    // drop what couldn't be simulated, keeping the fraction for alpha
+    if(accumulator >= fixedStep)
+    {
+        double keep = fmod(accumulator, fixedStep);
+        droppedTime += accumulator - keep;
+        accumulator = keep;
+    }
+
+    return steps;
+}
+
+void ParticleWorld::updateIslands(unsigned usedContacts)
+{
+    islands.Begin(store);
+
+    for(ParticleContactGenerator &gen : contactGens){
+        Particle *connected[2];
+        unsigned numConnected = gen.GetConnected(connected);
+        if(numConnected == 2)
+            islands.Connect(connected[0], connected[1]);
+    }
+
+    registry.Connect(islands);
+
+    // these are the contacts of the last frame for the next one
+    ParticleContact *contact = contacts.GetContacts();
+    for(unsigned i = 0; i < usedContacts; i++)
+        islands.Connect(contact[i].particle[0], contact[i].particle[1]);
+
+    islands.Update(store);
+}
+
+namespace
+{
+    /**
+     * Types of the contact generators that have state in the snapshot
+     */
+    enum class LinkType : unsigned char
+    {
+        None,
+        Rod,
+        Cable,
+        RodConstraint,
+        CableConstraint
+    };
+
+    void checkType(LinkType type, LinkType expected)
+    {
+        if(type != expected)
+            throw std::runtime_error("snapshot has different contact generators");
+    }
+
+    void writeAnchor(ParticleSnapshot &snapshot, const Point3D &anchor)
+    {
+        snapshot.Write((real)anchor.X);
+        snapshot.Write((real)anchor.Y);
+        snapshot.Write((real)anchor.Z);
+    }
+
+    Point3D readAnchor(ParticleSnapshot::Reader &reader, unsigned realSize)
+    {
+        real p[3];
+        reader.ReadReals(p, 3, realSize);
+        return Point3D(p[0], p[1], p[2]);
+    }
+}
+
+void ParticleWorld::Save(ParticleSnapshot &snapshot)
+{
+    flushRemoved();
+    syncParticles();
+
+    snapshot.Clear();
+    snapshot.Write(ParticleSnapshot::Magic);
+    snapshot.Write(ParticleSnapshot::Version);
+    snapshot.Write(ParticleStore::Axes);
+    snapshot.Write((unsigned)sizeof(real));
+
+    snapshot.Write(fixedStep);
+    snapshot.Write(accumulator);
+    snapshot.Write(droppedTime);
+    snapshot.Write(maxSubsteps);
+    snapshot.Write(resolver.GetIterations());
+    snapshot.Write((unsigned)resolver.GetMode());
+    snapshot.Write((unsigned char)calculateIterations);
+    snapshot.Write((unsigned)linkSolver);
+    snapshot.Write(islands.threshold);
+    snapshot.Write(islands.frames);
+
+    store.Save(snapshot);
+    islands.Save(snapshot);
+
+    // the cached contacts refer to the particles by their index
+    const unsigned None = (unsigned)-1;
+    snapshot.Write((unsigned char)warmStarting);
+    snapshot.Write(contactCache.GetCount());
+    contactCache.ForEach([&](const Particle *first, const Particle *second, unsigned feature, real impulse){
+        snapshot.Write(first->GetIndex());
+        snapshot.Write(second ? second->GetIndex() : None);
+        snapshot.Write(feature);
+        snapshot.Write(impulse);
+    });
+
+    snapshot.Write((unsigned)contactGens.GetCount());
+    for(ParticleContactGenerator &gen : contactGens){
+        if(auto rod = dynamic_cast<RodLink*>(&gen))
+        {
+            snapshot.Write(LinkType::Rod);
+            snapshot.Write(rod->length);
+            snapshot.Write(rod->compliance);
+        }
+        else if(auto cable = dynamic_cast<CableLink*>(&gen))
+        {
+            snapshot.Write(LinkType::Cable);
+            snapshot.Write(cable->maxLength);
+            snapshot.Write(cable->restitution);
+            snapshot.Write(cable->compliance);
+        }
+        else if(auto rod = dynamic_cast<RodConstraints*>(&gen))
+        {
+            snapshot.Write(LinkType::RodConstraint);
+            snapshot.Write(rod->length);
+            snapshot.Write(rod->compliance);
+            writeAnchor(snapshot, rod->anchor);
+        }
+        else if(auto cable = dynamic_cast<CableConstraints*>(&gen))
+        {
+            snapshot.Write(LinkType::CableConstraint);
+            snapshot.Write(cable->maxLength);
+            snapshot.Write(cable->restitution);
+            snapshot.Write(cable->compliance);
+            writeAnchor(snapshot, cable->anchor);
+        }
+        else
+        {
+            snapshot.Write(LinkType::None);
+        }
+    }
+}
+
+void ParticleWorld::Restore(const ParticleSnapshot &snapshot)
+{
+    flushRemoved();
+    syncParticles();
+
+    // everything is read into locals and staging copies first, the world
+    // is only changed once the whole snapshot is read and checked
+    ParticleSnapshot::Reader reader(snapshot);
+    if(reader.Read<unsigned>() != ParticleSnapshot::Magic)
+        throw std::runtime_error("data is not a particle world snapshot");
+    unsigned version = reader.Read<unsigned>();
+    if(version > ParticleSnapshot::Version)
+        throw std::runtime_error("snapshot is written by a newer version");
+
+    unsigned axes = reader.Read<unsigned>();
+    unsigned realSize = reader.Read<unsigned>();
+
+    // times are always double
+    double fixedStep = reader.Read<double>();
+    double accumulator = reader.Read<double>();
+    double droppedTime = reader.Read<double>();
+    unsigned maxSubsteps = reader.Read<unsigned>();
+    unsigned iterations = reader.Read<unsigned>();
+    unsigned mode = reader.Read<unsigned>();
+    bool calculateIterations = reader.Read<unsigned char>() != 0;
+    unsigned linkSolver = reader.Read<unsigned>();
+    real threshold;
+    reader.ReadReals(&threshold, 1, realSize);
+    unsigned frames = reader.Read<unsigned>();
+
+    if(mode > (unsigned)ParticleContactResolver::Mode::Parallel)
+        throw std::runtime_error("snapshot has an unknown resolver mode");
+    if(linkSolver > (unsigned)LinkSolver::XPBD)
+        throw std::runtime_error("snapshot has an unknown link solver");
+
+    restoreStore.Restore(reader, version, axes, realSize, store.GetCount());
+    restoreIslands.Restore(reader);
+
+    struct CachedContact
+    {
+        unsigned first, second, feature;
+        real impulse;
+    };
+    const unsigned None = (unsigned)-1;
+    bool warmStarting = this->warmStarting;
+    std::vector<CachedContact> cached;
+    if(version >= 2)
+    {
+        warmStarting = reader.Read<unsigned char>() != 0;
+
+        cached.resize(reader.ReadLength(3 * sizeof(unsigned) + realSize));
+        for(CachedContact &c : cached)
+        {
+            c.first = reader.Read<unsigned>();
+            c.second = reader.Read<unsigned>();
+            c.feature = reader.Read<unsigned>();
+            reader.ReadReals(&c.impulse, 1, realSize);
+
+            if(c.first >= store.GetCount() || (c.second != None && c.second >= store.GetCount()))
+                throw std::runtime_error("snapshot has a different number of particles");
+        }
+    }
+
+    if(reader.Read<unsigned>() != (unsigned)contactGens.GetCount())
+        throw std::runtime_error("snapshot has different contact generators");
+
+    struct LinkState
+    {
+        LinkType type;
+        real values[3];
+        Point3D anchor;
+    };
+    std::vector<LinkState> links;
+    links.reserve(contactGens.GetCount());
+
+    for(ParticleContactGenerator &gen : contactGens){
+        LinkState link;
+        link.type = reader.Read<LinkType>();
+
+        if(dynamic_cast<RodLink*>(&gen))
+        {
+            checkType(link.type, LinkType::Rod);
+            reader.ReadReals(link.values, 2, realSize);
+        }
+        else if(dynamic_cast<CableLink*>(&gen))
+        {
+            checkType(link.type, LinkType::Cable);
+            reader.ReadReals(link.values, 3, realSize);
+        }
+        else if(dynamic_cast<RodConstraints*>(&gen))
+        {
+            checkType(link.type, LinkType::RodConstraint);
+            reader.ReadReals(link.values, 2, realSize);
+            link.anchor = readAnchor(reader, realSize);
+        }
+        else if(dynamic_cast<CableConstraints*>(&gen))
+        {
+            checkType(link.type, LinkType::CableConstraint);
+            reader.ReadReals(link.values, 3, realSize);
+            link.anchor = readAnchor(reader, realSize);
+        }
+        else
+        {
+            checkType(link.type, LinkType::None);
+        }
+
+        links.push_back(link);
+    }
+
+    if(!reader.AtEnd())
+        throw std::runtime_error("snapshot has different contact generators");
+
+    // the snapshot is valid, apply it
+    this->fixedStep = fixedStep;
+    this->accumulator = accumulator;
+    this->droppedTime = droppedTime;
+    this->maxSubsteps = maxSubsteps;
+    resolver.SetIterations(iterations);
+    resolver.SetMode((ParticleContactResolver::Mode)mode);
+    this->calculateIterations = calculateIterations;
+    this->linkSolver = (LinkSolver)linkSolver;
+
+    store.Adopt(restoreStore);
+    std::swap(islands, restoreIslands);
+    islands.threshold = threshold;
+    islands.frames = frames;
+
+    this->warmStarting = warmStarting;
+    contactCache.Clear();
+    for(const CachedContact &c : cached)
+    {
+        // released and emitter slots have no particle objects to key
+        // the contacts with
+        Particle *first = store.views[c.first];
+        Particle *second = c.second == None ? nullptr : store.views[c.second];
+        if(first == nullptr || (c.second != None && second == nullptr)) continue;
+
+        contactCache.Set(first, second, c.feature, c.impulse);
+    }
+
+    unsigned i = 0;
+    for(ParticleContactGenerator &gen : contactGens){
+        const LinkState &link = links[i++];
+
+        switch(link.type)
+        {
+        case LinkType::Rod:
+            static_cast<RodLink&>(gen).length = link.values[0];
+            static_cast<RodLink&>(gen).compliance = link.values[1];
+            break;
+        case LinkType::Cable:
+            static_cast<CableLink&>(gen).maxLength = link.values[0];
+            static_cast<CableLink&>(gen).restitution = link.values[1];
+            static_cast<CableLink&>(gen).compliance = link.values[2];
+            break;
+        case LinkType::RodConstraint:
+            static_cast<RodConstraints&>(gen).length = link.values[0];
+            static_cast<RodConstraints&>(gen).compliance = link.values[1];
+            static_cast<RodConstraints&>(gen).anchor = link.anchor;
+            break;
+        case LinkType::CableConstraint:
+            static_cast<CableConstraints&>(gen).maxLength = link.values[0];
+            static_cast<CableConstraints&>(gen).restitution = link.values[1];
+            static_cast<CableConstraints&>(gen).compliance = link.values[2];
+            static_cast<CableConstraints&>(gen).anchor = link.anchor;
+            break;
+        case LinkType::None:
+            break;
         }
-        resolver.ResolveContacts(contacts, usedContacts, time);
     }
 }
 
@@ -103,6 +751,8 @@ void ParticleWorld::RunPhysics(unsigned time)
 // }
 
 Collection<Particle> &ParticleWorld::GetParticles(){
+    // the caller may add particles that aren't in the store yet
+    particlesChanged = true;
     return particles;
 }
 
@@ -114,6 +764,9 @@ Collection<Particle> &ParticleWorld::GetParticles(){
 void GroundContacts::init(Containers::Collection<Particle> &particle)
 {
 //     GroundContacts::particles = particle;
+    for(Particle &p : particle){
+        particles.Add(p);
+    }
 }
 
 unsigned GroundContacts::AddContact(ParticleContact *contact, unsigned limit) const
@@ -121,13 +774,15 @@ unsigned GroundContacts::AddContact(ParticleContact *contact, unsigned limit) co
     unsigned count = 0;
     Point3D UP(0, 1, 0);
     for(Particle &p : particles){
-        double y = p.GetPosition().Y;
+        if(!p.IsAwake()) continue;
+
+        real y = p.GetPosition().Y;
         if(y<0.0f){
             contact->ContactNormal = UP;
             contact->particle[0] = &p;
             contact->particle[1] = NULL;
             contact->penetration = -y;
-            contact->restitution = 0.2f;
+            contact->restitution = restitution;
             contact++;
             count++;
         }
@@ -9,6 +9,17 @@
 
 
 #include "particle.h"
+#include "pstore.h"
+#include "pintegrate.h"
+#include "pislands.h"
+#include "pintegrators.h"
+#include "pimplicit.h"
+#include "pxpbd.h"
+#include "pjobs.h"
+#include "pstats.h"
+#include "psnapshot.h"
+
+#include <vector>
 #include "pcontacts.h"
 #include "pfgen.h"
 
@@ -30,6 +41,19 @@ namespace Gorgon
         class ParticleWorld
         {
         public:
+            /**
+             * How the world keeps rods and cables together
+             */
+            enum class LinkSolver
+            {
+                /// Links generate contacts that the resolver handles
+                Contacts,
+
+                /// Links are solved on the positions by the XPBD solver,
+                /// which also integrates the particles in substeps
+                XPBD
+            };
+
             /// *** Colliction 
             /// Where all particles in the world stored;
 //             typedef std::vector<Particle*> Particles; 
@@ -38,11 +62,51 @@ namespace Gorgon
 //             typedef std::vector<ParticleContactGenerator*> ContactGenerators;
         protected:
 
+            /**
+             * Holds the state of all particles of this world
+             * in structure-of-arrays form
+             */
+            ParticleStore store;
+
+            /**
+             * Holds the batch integrator for the particles in the store
+             */
+            ParticleIntegrator integrator;
+
             /**
              * Holds all particles 
              */
             Gorgon::Containers::Collection<Particle> particles;
 
+            /**
+             * Holds the particle views that are created by the world
+             */
+            Gorgon::Containers::Collection<Particle> ownedParticles;
+
+            /**
+             * True when the particles collection may have been changed
+             * from outside, through GetParticles, since the last sync.
+             */
+            bool particlesChanged = false;
+
+            /**
+             * Particles that are removed since the last frame. They are
+             * taken out of the collections, the force registry and the
+             * contact generators at the start of the next frame.
+             */
+            std::vector<Particle*> removedParticles;
+
+            /**
+             * Particle objects of the removed particles that were owned
+             * by the world, reused by AddParticle
+             */
+            std::vector<Particle*> particlePool;
+
+            /**
+             * New index of each slot, used when the slots are remapped
+             */
+            std::vector<unsigned> remap;
+
             /**
              * Holds all contact generators
             */
@@ -59,25 +123,94 @@ namespace Gorgon
             ParticleContactResolver resolver;
 
             /**
-             * Holds a list of contacts 
+             * Holds the contacts of the current frame
+             */
+            ParticleContactArena contacts;
+
+            /**
+             * Holds the impulses of the last frame's contacts
              */
-            ParticleContact *contacts;
+            ParticleContactCache contactCache;
+            bool warmStarting = false;
 
             /**
-             * Holds the maximum number of contacts allowed 
+             * Holds the islands of particles, used to put
+             * resting particles to sleep
              */
-            unsigned maxContacts;
+            ParticleIslands islands;
+
+            /**
+             * Staging state that Restore reads into, so a snapshot that's
+             * rejected leaves the world unchanged. Kept to reuse their
+             * memory.
+             */
+            ParticleStore restoreStore;
+            ParticleIslands restoreIslands;
 
             /**
              * True if the world should calculate the number of iterations
              * to give the contact resolver at each frame.
              */
             bool calculateIterations;
+
+            /**
+             * Runs the parallel stages, not owned by the world
+             */
+            ThreadPool *pool = nullptr;
+
+            /**
+             * True if the contact generators run in parallel
+             */
+            bool parallelContacts = false;
+
+            /**
+             * Per worker contacts and the generators of the
+             * frame, for the parallel contact generation
+             */
+            std::vector<ParticleContactArena> workerContacts;
+            std::vector<const ParticleContactGenerator*> activeGens;
+            std::vector<unsigned> genContacts;
+
+            /**
+             * Holds the statistics of the last frame, only
+             * collected when GORGON_PHYSICS_PROFILE is defined
+             */
+            ParticleWorldStats stats;
+
+            /**
+             * True while Step runs its substeps
+             */
+            bool stepping = false;
+
+            /**
+             * Holds the XPBD solver and whether it's used for the links
+             */
+            ParticleXPBD xpbd;
+            LinkSolver linkSolver = LinkSolver::Contacts;
+
+            /**
+             * The contact generators as of the last classification and
+             * whether the XPBD solver handles each of them. The XPBD
+             * constraints are built at the same time and kept until the
+             * generators or the slots of the particles change.
+             */
+            std::vector<ParticleContactGenerator*> classifiedGens;
+            std::vector<unsigned char> xpbdGens;
+            bool linksChanged = true;
+
+            /**
+             * Fixed step state, see Step
+             */
+            double fixedStep = 1.0 / 60;
+            unsigned maxSubsteps = 8;
+            double accumulator = 0;
+            double droppedTime = 0;
             
         public:
             /**
-            * Creates a new particle simulator that can handle up to the
-            * given number of contacts per frame. You can also optionally
+            * Creates a new particle simulator that starts with room for
+            * the given number of contacts per frame. The room grows when
+            * the contact generators need more. You can also optionally
             * give a number of contact-resolution iterations to use. If you
             * don’t give a number of iterations, then twice the number of
             * contacts will be used.
@@ -87,7 +220,7 @@ namespace Gorgon
             /**
              * Deletes the physically simulated world
             */
-           ~ParticleWorld();
+           virtual ~ParticleWorld();
 
            /**
             * Initializes the world for a simulation frame. This clears
@@ -107,7 +240,7 @@ namespace Gorgon
             * Integrates all the particles in this world forward in time
             * by the given duration.
             */
-            void Integrate(unsigned time);
+            virtual void Integrate(double time);
 
             /**
             * Processes all the physics for the particle world.
@@ -115,7 +248,51 @@ namespace Gorgon
             * apply their forces and then perform the intergration,
             * also runs the contact the detector and resolve contacts.
             */
-            void RunPhysics(unsigned time);
+            void RunPhysics(double time);
+
+            /**
+             * Advances the world by the given elapsed time (in seconds)
+             * using fixed steps. The elapsed time is added to an
+             * accumulator and as many fixed steps as fit in it are run, up
+             * to the maximum number of steps; the time that doesn't fit is
+             * dropped so a long hitch doesn't cause a longer one. The
+             * time that's left over is kept for the next call and gives
+             * the interpolation alpha. Returns the number of steps run.
+             *
+             * Forces added to the particles before calling this are
+             * applied in the first step only.
+             */
+            unsigned Step(double elapsed);
+
+            /**
+             * Sets the duration of a fixed step and the maximum number
+             * of steps a single call to Step can run. A zero step makes
+             * Step run a single step of the elapsed time.
+             */
+            inline void SetFixedStep(double step, unsigned maxSteps = 8){
+                fixedStep = step;
+                maxSubsteps = maxSteps;
+            };
+            inline double GetFixedStep() const{
+                return fixedStep;
+            };
+
+            /**
+             * Returns how far between the last two steps the current
+             * time is, between 0 and 1. Render the particles at their
+             * interpolated positions with this alpha.
+             */
+            inline double GetAlpha() const{
+                return fixedStep > 0 ? accumulator / fixedStep : 1;
+            };
+
+            /**
+             * Returns the total time that Step dropped because the
+             * maximum number of steps was reached.
+             */
+            inline double GetDroppedTime() const{
+                return droppedTime;
+            };
 
             /**
             * Returns the list of contact generators.
@@ -125,7 +302,69 @@ namespace Gorgon
             };
 
             /**
-             *  Returns the list of particles.
+             * Creates a new particle in this world and returns it.
+             * The particle is owned by the world.
+             */
+            Particle &AddParticle();
+
+            /**
+             * Adds the given particle to this world. The state of the
+             * particle is moved into the store of the world, the
+             * particle object itself is still owned by the caller.
+             */
+            void AddParticle(Particle &particle);
+
+            /**
+             * Removes the given particle from this world in constant time.
+             * Its handle stops working right away, but it's taken out of
+             * the particle list, the force registry and the contact
+             * generators at the start of the next frame, and its slot is
+             * reused after that. Rods, cables and springs that connect the
+             * particle are dropped. Particles that are created by the
+             * world are reused by AddParticle, the ones that are added by
+             * the caller are left to the caller.
+             */
+            void RemoveParticle(Particle &particle);
+
+            /**
+             * Returns the particle that the handle refers to, or nullptr
+             * if the particle is removed.
+             */
+            inline Particle *GetParticle(ParticleHandle handle) const{
+                unsigned index = store.Find(handle);
+                return index == ParticleStore::NoIndex ? nullptr : store.views[index];
+            };
+
+            /**
+             * Moves the live particles to the front of the store so that
+             * the loops over the store don't walk the removed slots. The
+             * particles keep their handles but change their indices.
+             * Snapshots that are saved before compacting can't be
+             * restored after it.
+             */
+            void Compact();
+
+            /**
+             * Returns the store that holds the state of the particles.
+             */
+            inline ParticleStore &GetStore(){
+                return store;
+            };
+
+            /**
+             * Returns the batch integrator, which can be used to select
+             * the instruction set used for the integration.
+             */
+            inline ParticleIntegrator &GetIntegrator(){
+                return integrator;
+            };
+
+            /**
+             *  Returns the list of particles. Particles that are added
+             *  directly to this list are moved into the store of the
+             *  world on the next frame. The list is checked again after
+             *  each call to this function, so it shouldn't be changed
+             *  through a reference kept from an earlier frame.
              */
             Gorgon::Containers::Collection<Particle>& GetParticles();
 
@@ -133,12 +372,223 @@ namespace Gorgon
             * Returns the force registry.
             */
             ParticleForceRegistry& GetForceRegistry();
+
+            /**
+             * Enables putting the particles to sleep. An island of
+             * connected particles whose average kinetic energy per
+             * particle stays below the given threshold for the given
+             * number of frames falls asleep. Zero frames disables it.
+             */
+            inline void SetSleeping(real threshold, unsigned frames){
+                islands.threshold = threshold;
+                islands.frames = frames;
+            };
+
+            /**
+             * Selects how rods and cables are solved. With XPBD the links
+             * in the contact generators are solved by the XPBD solver and
+             * don't generate contacts, and the XPBD solver replaces the
+             * integrator of the world. The other contact generators are
+             * handled by the resolver as usual.
+             */
+            inline void SetLinkSolver(LinkSolver solver){
+                linkSolver = solver;
+            };
+            inline LinkSolver GetLinkSolver() const{
+                return linkSolver;
+            };
+
+            /**
+             * Enables warm starting the contact resolver. The impulses of
+             * the contacts are kept across frames and applied again at the
+             * start of the next frame, so resting contacts and taut links
+             * need far fewer iterations to settle.
+             */
+            inline void SetWarmStarting(bool value){
+                warmStarting = value;
+                if(!value) contactCache.Clear();
+            };
+            inline bool GetWarmStarting() const{
+                return warmStarting;
+            };
+
+            /**
+             * Returns the contact cache that's used for warm starting
+             */
+            inline ParticleContactCache &GetContactCache(){
+                return contactCache;
+            };
+
+            /**
+             * Returns the XPBD solver, to set its substeps and iterations
+             */
+            inline ParticleXPBD &GetXPBD(){
+                return xpbd;
+            };
+
+            /**
+             * Sets the thread pool for the parallel stages. The pool is
+             * not owned by the world and is also given to the resolver.
+             */
+            inline void SetThreadPool(ThreadPool *pool){
+                this->pool = pool;
+                resolver.SetThreadPool(pool);
+            };
+
+            /**
+             * Runs the contact generators in parallel on the thread pool.
+             * Each worker writes into its own contact buffer and the
+             * buffers are merged in generator order, so the contacts are
+             * the same as with the serial generation. The generators
+             * should only read shared state in AddContact.
+             */
+            inline void SetParallelContacts(bool value){
+                parallelContacts = value;
+            };
+
+            /**
+             * Writes the dynamic state of the world to the snapshot: the
+             * state of the particles including their accumulated forces,
+             * the parameters of the rods and cables, the sleeping state,
+             * the warm starting impulses, the handles of the particles
+             * and the settings of the resolver and the stepping.
+             * Removed particles are taken out of the world first. The
+             * memory of the snapshot is reused.
+             */
+            void Save(ParticleSnapshot &snapshot);
+
+            /**
+             * Restores the state that's written by Save. The world should
+             * have the same particles and contact generators as when the
+             * snapshot was saved. Throws if the snapshot doesn't match,
+             * in which case the world is left unchanged.
+             */
+            void Restore(const ParticleSnapshot &snapshot);
+
+            /**
+             * Returns the timings and the counters of the last frame. A
+             * frame is a call to Step, or to RunPhysics outside of Step.
+             * They are only collected when the engine is built with
+             * GORGON_PHYSICS_PROFILE, otherwise they stay zero.
+             */
+            inline const ParticleWorldStats &GetStats() const{
+                return stats;
+            };
+
+            /**
+             * Returns the contact arena, which holds the contacts of the
+             * last frame and the statistics on the number of contacts.
+             */
+            inline ParticleContactArena &GetContactArena(){
+                return contacts;
+            };
+
+            /**
+            * Returns the contact resolver.
+            */
+            inline ParticleContactResolver& GetResolver(){
+                return resolver;
+            };
+
+        protected:
+            /**
+             * Moves any particle that's added to the particles
+             * collection directly into the store, if the collection was
+             * handed out since the last sync.
+             */
+            void syncParticles();
+
+            /**
+             * Takes the particles that are removed since the last frame
+             * out of the world
+             */
+            void flushRemoved();
+
+            /**
+             * Classifies the contact generators and builds the XPBD
+             * constraints again if the generators are added or removed,
+             * or the particles moved to other slots, since the last call
+             */
+            void classifyGenerators();
+
+            /**
+             * Returns whether the generator at the given index of the
+             * classified generators should be skipped in this frame,
+             * because the XPBD solver handles it or because all of its
+             * particles are asleep.
+             */
+            bool skipGenerator(unsigned index) const;
+
+            /**
+             * Runs the contact generators on the thread pool
+             */
+            unsigned generateParallel();
+
+            /**
+             * Rebuilds the islands from the contact generators and
+             * the contacts of this frame, and updates sleeping.
+             */
+            void updateIslands(unsigned usedContacts);
+
+            /**
+             * Integrates the particles and solves the links
+             * with the XPBD solver
+             */
+            void solveLinks(double time);
+
+            /**
+             * Called after the contacts of a step are resolved. Worlds
+             * with an integrator that works out the velocities from the
+             * positions override it.
+             */
+            virtual void finishIntegration(double /*time*/){ }
         };
 
+        /**
+         * A particle world that integrates with the given integrator
+         * policy (see pintegrators.h). The policy is inlined into the
+         * integration loop.
+         */
+        template<class Integrator_>
+        class basic_ParticleWorld : public ParticleWorld
+        {
+        public:
+            using ParticleWorld::ParticleWorld;
+
+            virtual void Integrate(double time) override{
+                syncParticles();
+
+                policy.Integrate(store, time, [this, time]{
+                    store.ClearAccumulators();
+                    registry.UpdateForces(time);
+                });
+            }
+
+            /**
+             * Returns the integrator policy
+             */
+            inline Integrator_ &GetPolicy(){
+                return policy;
+            };
+
+        protected:
+            virtual void finishIntegration(double time) override{
+                policy.Finish(store, time);
+            }
+
+            Integrator_ policy;
+        };
+
+        typedef basic_ParticleWorld<SemiImplicitEuler> SemiImplicitParticleWorld;
+        typedef basic_ParticleWorld<PositionVerlet> VerletParticleWorld;
+        typedef basic_ParticleWorld<MidpointRK2> RK2ParticleWorld;
+        typedef basic_ParticleWorld<ImplicitEuler> ImplicitParticleWorld;
+
 
         /**
          * Ground contact generator that takes a vector of 
-         * particles and collides them against the ground
+         * particles and collides them against the ground.
+         * StaticGeometry handles any other level geometry.
          */
         class GroundContacts : public ParticleContactGenerator
         {
@@ -147,6 +597,15 @@ namespace Gorgon
 //             ParticleWorld::Particles *particles;
 
         public:
+            /**
+             * Holds the restitution of the ground
+             */
+            real restitution = 0.2;
+
+            /**
+             * Adds the given particles to the ones that
+             * collide with the ground
+             */
             void init(Containers::Collection<Particle> &particle);
 
             virtual unsigned AddContact(ParticleContact *contact, unsigned limit) const;
@@ -0,0 +1,207 @@
+/**
+ * @file pxpbd.cpp is the implementation for pxpbd.h
+ */
+#include <Gorgon/Physics/pxpbd.h>
+#include <Gorgon/Physics/plinks.h>
+#include <cmath>
+#include <stdexcept>
+
+using Gorgon::Geometry::Point3D;
+using namespace Gorgon::Physics;
+
+void ParticleXPBD::Clear()
+{
+    links.clear();
+}
+
+void ParticleXPBD::AddLink(unsigned first, unsigned second, real length, real compliance, bool cable)
+{
+    Link link = {first, second, length, compliance, cable, false, {0}, nullptr};
+    links.push_back(link);
+}
+
+void ParticleXPBD::AddAnchor(unsigned particle, const Point3D &anchor, real length, real compliance, bool cable)
+{
+    Link link = {particle, particle, length, compliance, cable, true, {0}, nullptr};
+    ParticleStore::ToArray(anchor, link.anchor);
+    links.push_back(link);
+}
+
+bool ParticleXPBD::Handles(const ParticleContactGenerator &gen)
+{
+    return dynamic_cast<const RodLink*>(&gen) || dynamic_cast<const CableLink*>(&gen) ||
+           dynamic_cast<const RodConstraints*>(&gen) || dynamic_cast<const CableConstraints*>(&gen);
+}
+
+bool ParticleXPBD::Add(const ParticleContactGenerator &gen, const ParticleStore &store)
+{
+    auto inStore = [&store](const Particle *p){
+        return p != nullptr && p->IsIn(store);
+    };
+
+    if(auto rod = dynamic_cast<const RodLink*>(&gen))
+    {
+        if(!inStore(rod->particle[0]) || !inStore(rod->particle[1])) return false;
+        AddLink(rod->particle[0]->GetIndex(), rod->particle[1]->GetIndex(), rod->length, rod->compliance, false);
+    }
+    else if(auto cable = dynamic_cast<const CableLink*>(&gen))
+    {
+        if(!inStore(cable->particle[0]) || !inStore(cable->particle[1])) return false;
+        AddLink(cable->particle[0]->GetIndex(), cable->particle[1]->GetIndex(), cable->maxLength, cable->compliance, true);
+    }
+    else if(auto rod = dynamic_cast<const RodConstraints*>(&gen))
+    {
+        if(!inStore(rod->particle)) return false;
+        AddAnchor(rod->particle->GetIndex(), rod->anchor, rod->length, rod->compliance, false);
+    }
+    else if(auto cable = dynamic_cast<const CableConstraints*>(&gen))
+    {
+        if(!inStore(cable->particle)) return false;
+        AddAnchor(cable->particle->GetIndex(), cable->anchor, cable->maxLength, cable->compliance, true);
+    }
+    else
+    {
+        return false;
+    }
+
+    links.back().source = &gen;
+
+    return true;
+}
+
+void ParticleXPBD::Refresh()
+{
+    // the kind of the generator is known from the link, so no casts
+    // need to be checked
+    for(Link &link : links)
+    {
+        if(link.source == nullptr) continue;
+
+        if(!link.anchored && !link.cable)
+        {
+            auto rod = static_cast<const RodLink*>(link.source);
+            link.length = rod->length;
+            link.compliance = rod->compliance;
+        }
+        else if(!link.anchored)
+        {
+            auto cable = static_cast<const CableLink*>(link.source);
+            link.length = cable->maxLength;
+            link.compliance = cable->compliance;
+        }
+        else if(!link.cable)
+        {
+            auto rod = static_cast<const RodConstraints*>(link.source);
+            link.length = rod->length;
+            link.compliance = rod->compliance;
+            ParticleStore::ToArray(rod->anchor, link.anchor);
+        }
+        else
+        {
+            auto cable = static_cast<const CableConstraints*>(link.source);
+            link.length = cable->maxLength;
+            link.compliance = cable->compliance;
+            ParticleStore::ToArray(cable->anchor, link.anchor);
+        }
+    }
+}
+
+void ParticleXPBD::Step(ParticleStore &store, double time)
+{
+    if(time < 0.0)
+        throw std::runtime_error("time cannot be less than zero");
+
+    unsigned count = store.GetCount();
+    unsigned steps = substeps ? substeps : 1;
+    real h = time / steps;
+
+    for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        start[a].resize(count);
+
+    for(unsigned s = 0; s < steps; s++)
+    {
+        // predict the positions with semi-implicit euler
+        real lastDamping = 1, drag = 1;
+        for(unsigned i = 0; i < count; i++)
+        {
+            if(!store.IsActive(i)) continue;
+
+            if(store.damping[i] != lastDamping)
+            {
+                lastDamping = store.damping[i];
+                drag = pow(lastDamping, h);
+            }
+
+            for(unsigned a = 0; a < ParticleStore::Axes; a++)
+            {
+                real acc = store.acceleration[a][i] + store.forceAccum[a][i] * store.inverseMass[i];
+                store.velocity[a][i] = (store.velocity[a][i] + acc * h) * drag;
+
+                start[a][i] = store.position[a][i];
+                store.position[a][i] += store.velocity[a][i] * h;
+            }
+        }
+
+        lambda.assign(links.size(), 0);
+        for(unsigned k = 0; k < iterations; k++)
+            solve(store, h);
+
+        // the velocity is how far the particle moved
+        if(h > 0)
+        {
+            for(unsigned i = 0; i < count; i++)
+            {
+                if(!store.IsActive(i)) continue;
+
+                for(unsigned a = 0; a < ParticleStore::Axes; a++)
+                    store.velocity[a][i] = (store.position[a][i] - start[a][i]) / h;
+            }
+        }
+    }
+
+    for(unsigned i = 0; i < count; i++)
+        if(store.IsActive(i)) store.ClearAccumulator(i);
+}
+
+void ParticleXPBD::solve(ParticleStore &store, double substep)
+{
+    real hSq = substep * substep;
+
+    for(unsigned c = 0; c < links.size(); c++)
+    {
+        const Link &link = links[c];
+        unsigned i = link.first, j = link.second;
+
+        // sleeping and infinite mass particles don't move
+        real wi = store.IsActive(i) ? store.inverseMass[i] : 0;
+        real wj = (!link.anchored && store.IsActive(j)) ? store.inverseMass[j] : 0;
+        if(wi + wj <= 0) continue;
+
+        real d[ParticleStore::Axes], length = 0;
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        {
+            real other = link.anchored ? link.anchor[a] : store.position[a][j];
+            d[a] = store.position[a][i] - other;
+            length += d[a] * d[a];
+        }
+        length = std::sqrt(length);
+        if(length == 0) continue;
+
+        real violation = length - link.length;
+
+        // a cable is slack when it's shorter than its length
+        if(link.cable && violation <= 0) continue;
+
+        real alpha = hSq > 0 ? link.compliance / hSq : 0;
+        real deltaLambda = (-violation - alpha * lambda[c]) / (wi + wj + alpha);
+        lambda[c] += deltaLambda;
+
+        for(unsigned a = 0; a < ParticleStore::Axes; a++)
+        {
+            real n = d[a] / length;
+            store.position[a][i] += wi * deltaLambda * n;
+            if(!link.anchored)
+                store.position[a][j] -= wj * deltaLambda * n;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file pxpbd.h contains the XPBD link solver
+ *
+ * @brief The XPBD (extended position based dynamics) solver is an
+ * alternative to turning rods and cables into contacts. Each link is a
+ * distance constraint that is solved directly on the positions, and the
+ * velocities are worked out from how far the particles moved. The time
+ * step is split into substeps with one iteration each, which converges
+ * much faster than the impulse resolver for long chains and meshes.
+ *
+ * The solver uses the same links as the contact path (RodLink, CableLink,
+ * RodConstraints and CableConstraints) and their compliance member; zero
+ * compliance makes a link rigid, larger values make it softer regardless
+ * of the time step and the number of substeps.
+ */
+#pragma once
+
+#include <Gorgon/Physics/pstore.h>
+#include <Gorgon/Physics/pcontacts.h>
+#include <vector>
+
+namespace Gorgon
+{
+    namespace Physics
+    {
+        class ParticleXPBD
+        {
+        public:
+            /**
+             * Number of substeps each step is split into
+             */
+            unsigned substeps = 8;
+
+            /**
+             * Number of solver iterations in each substep
+             */
+            unsigned iterations = 1;
+
+            /**
+             * Removes all the constraints
+             */
+            void Clear();
+
+            /**
+             * Adds a constraint that keeps two particles at the given
+             * distance. A cable only keeps them from going further.
+             */
+            void AddLink(unsigned first, unsigned second, real length, real compliance, bool cable);
+
+            /**
+             * Adds a constraint that keeps a particle at the given
+             * distance from an anchor. A cable only keeps it from
+             * going further.
+             */
+            void AddAnchor(unsigned particle, const Point3D &anchor, real length, real compliance, bool cable);
+
+            /**
+             * Returns whether the given generator is a link that this
+             * solver can handle
+             */
+            static bool Handles(const ParticleContactGenerator &gen);
+
+            /**
+             * Adds the constraint of the given link if the solver can
+             * handle it and its particles are in the given store.
+             * Returns whether the link is added.
+             */
+            bool Add(const ParticleContactGenerator &gen, const ParticleStore &store);
+
+            /**
+             * Reads the lengths, compliances and anchors of the links
+             * added with Add from their generators again, so that the
+             * changes to them apply without adding the links again. The
+             * particles of the links are only read by Add.
+             */
+            void Refresh();
+
+            /**
+             * Integrates the particles of the store and solves the
+             * constraints, in substeps. The force accumulators are
+             * used for the whole step and cleared at the end.
+             */
+            void Step(ParticleStore &store, double time);
+
+            inline unsigned GetConstraintCount() const{
+                return (unsigned)links.size();
+            };
+
+        protected:
+            struct Link
+            {
+                unsigned first, second;
+                real length;
+                real compliance;
+                bool cable;
+                bool anchored;
+                real anchor[ParticleStore::Axes];
+
+                /// The generator the link is added from, if any
+                const ParticleContactGenerator *source;
+            };
+
+            /**
+             * Solves all the constraints once for the given substep
+             */
+            void solve(ParticleStore &store, double substep);
+
+            std::vector<Link> links;
+
+            /**
+             * Holds the accumulated Lagrange multiplier of each
+             * constraint, reset each substep
+             */
+            std::vector<real> lambda;
+
+            /**
+             * Holds the positions at the start of the substep
+             */
+            std::vector<real> start[ParticleStore::Axes];
+        };
+    }
+}